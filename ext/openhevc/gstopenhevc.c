@@ -25,6 +25,8 @@
 #include <gst/gst.h>
 
 #include "gstopenhevc.h"
+#include "gstopenhevccopy.h"
+#include "gstopenhevcstats.h"
 #include "gstopenhevcviddec.h"
 
 #define LICENSE "LGPL"
@@ -36,9 +38,16 @@ plugin_init (GstPlugin * plugin)
 {
   GST_DEBUG_CATEGORY_INIT (openhevc_debug, "openhevc", 0, "openhevc elements");
 
+  GST_INFO ("using %s plane copy implementation",
+      gst_openhevc_copy_get_impl_name ());
+
   if (!gst_openhevcviddec_register (plugin))
     return FALSE;
 
+  if (!gst_tracer_register (plugin, "openhevcstats",
+          GST_TYPE_OPENHEVC_STATS_TRACER))
+    return FALSE;
+
   /* Now we can return the pointer to the newly created Plugin object. */
   return TRUE;
 }
@@ -0,0 +1,912 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Plane copy kernels used when decoded pictures need to be copied out of
+ * OpenHEVC's picture buffers.  The implementation is chosen once at runtime
+ * depending on the CPU features.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "gstopenhevccopy.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+/* used when the size of the last level cache can't be queried */
+#define DEFAULT_LLC_SIZE (8 * 1024 * 1024)
+
+typedef void (*CopyRowFunc) (guint8 * dst, const guint8 * src, gsize n);
+typedef void (*InterleaveRowFunc) (guint8 * dst, const guint8 * src_a,
+    const guint8 * src_b, gsize n);
+typedef void (*FenceFunc) (void);
+/* adds a row of 8 or 16 bit samples to 16 bit accumulators */
+typedef void (*AccumulateRowFunc) (guint16 * acc, const guint8 * src,
+    gsize n);
+/* 16 to 8 bit samples, adding the rounding or dither offsets that repeat
+ * every 4 samples before dropping the low @shift bits */
+typedef void (*ReduceRowFunc) (guint8 * dst, const guint16 * src, gsize n,
+    const guint16 * offsets, guint shift);
+
+typedef struct
+{
+  const gchar *name;
+  CopyRowFunc copy;
+  /* optional, streaming stores bypassing the cache */
+  CopyRowFunc copy_nt;
+  FenceFunc fence;
+  InterleaveRowFunc interleave;
+  AccumulateRowFunc accumulate_u8;
+  AccumulateRowFunc accumulate_u16;
+  ReduceRowFunc reduce;
+} CopyImpl;
+
+static CopyImpl copy_impl;
+static gsize llc_size;
+
+const gchar *const gst_openhevc_copy_impl_names[] = {
+  "avx512", "avx2", "sse2", "c", NULL
+};
+
+/* ordered dither thresholds in sixteenths */
+static const guint8 bayer_4x4[4][4] = {
+  {0, 8, 2, 10},
+  {12, 4, 14, 6},
+  {3, 11, 1, 9},
+  {15, 7, 13, 5},
+};
+
+static void
+copy_row_c (guint8 * dst, const guint8 * src, gsize n)
+{
+  memcpy (dst, src, n);
+}
+
+static void
+interleave_row_c (guint8 * dst, const guint8 * src_a, const guint8 * src_b,
+    gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    dst[2 * i] = src_a[i];
+    dst[2 * i + 1] = src_b[i];
+  }
+}
+
+static void
+accumulate_row_u8_c (guint16 * acc, const guint8 * src, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    acc[i] += src[i];
+}
+
+static void
+accumulate_row_u16_c (guint16 * acc, const guint8 * src, gsize n)
+{
+  const guint16 *s = (const guint16 *) src;
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    acc[i] += s[i];
+}
+
+static void
+reduce_row_c (guint8 * dst, const guint16 * src, gsize n,
+    const guint16 * offsets, guint shift)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    guint v = (src[i] + offsets[i & 3]) >> shift;
+
+    dst[i] = MIN (v, 255);
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+__attribute__ ((target ("sse2")))
+static void
+fence_sse2 (void)
+{
+  _mm_sfence ();
+}
+
+__attribute__ ((target ("sse2")))
+static void
+copy_row_sse2 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + i + 16));
+    __m128i c = _mm_loadu_si128 ((const __m128i *) (src + i + 32));
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (src + i + 48));
+    _mm_storeu_si128 ((__m128i *) (dst + i), a);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 16), b);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 32), c);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 48), d);
+  }
+  for (; i + 16 <= n; i += 16)
+    _mm_storeu_si128 ((__m128i *) (dst + i),
+        _mm_loadu_si128 ((const __m128i *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+copy_row_nt_sse2 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = (16 - ((guintptr) dst & 15)) & 15;
+
+  /* streaming stores need an aligned destination */
+  if (i > n)
+    i = n;
+  memcpy (dst, src, i);
+
+  for (; i + 64 <= n; i += 64) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + i + 16));
+    __m128i c = _mm_loadu_si128 ((const __m128i *) (src + i + 32));
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (src + i + 48));
+    _mm_stream_si128 ((__m128i *) (dst + i), a);
+    _mm_stream_si128 ((__m128i *) (dst + i + 16), b);
+    _mm_stream_si128 ((__m128i *) (dst + i + 32), c);
+    _mm_stream_si128 ((__m128i *) (dst + i + 48), d);
+  }
+  for (; i + 16 <= n; i += 16)
+    _mm_stream_si128 ((__m128i *) (dst + i),
+        _mm_loadu_si128 ((const __m128i *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+copy_row_avx2 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 128 <= n; i += 128) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (src + i + 32));
+    __m256i c = _mm256_loadu_si256 ((const __m256i *) (src + i + 64));
+    __m256i d = _mm256_loadu_si256 ((const __m256i *) (src + i + 96));
+    _mm256_storeu_si256 ((__m256i *) (dst + i), a);
+    _mm256_storeu_si256 ((__m256i *) (dst + i + 32), b);
+    _mm256_storeu_si256 ((__m256i *) (dst + i + 64), c);
+    _mm256_storeu_si256 ((__m256i *) (dst + i + 96), d);
+  }
+  for (; i + 32 <= n; i += 32)
+    _mm256_storeu_si256 ((__m256i *) (dst + i),
+        _mm256_loadu_si256 ((const __m256i *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+copy_row_nt_avx2 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = (32 - ((guintptr) dst & 31)) & 31;
+
+  if (i > n)
+    i = n;
+  memcpy (dst, src, i);
+
+  for (; i + 128 <= n; i += 128) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (src + i + 32));
+    __m256i c = _mm256_loadu_si256 ((const __m256i *) (src + i + 64));
+    __m256i d = _mm256_loadu_si256 ((const __m256i *) (src + i + 96));
+    _mm256_stream_si256 ((__m256i *) (dst + i), a);
+    _mm256_stream_si256 ((__m256i *) (dst + i + 32), b);
+    _mm256_stream_si256 ((__m256i *) (dst + i + 64), c);
+    _mm256_stream_si256 ((__m256i *) (dst + i + 96), d);
+  }
+  for (; i + 32 <= n; i += 32)
+    _mm256_stream_si256 ((__m256i *) (dst + i),
+        _mm256_loadu_si256 ((const __m256i *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("avx512f")))
+static void
+copy_row_avx512 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 256 <= n; i += 256) {
+    __m512i a = _mm512_loadu_si512 ((const void *) (src + i));
+    __m512i b = _mm512_loadu_si512 ((const void *) (src + i + 64));
+    __m512i c = _mm512_loadu_si512 ((const void *) (src + i + 128));
+    __m512i d = _mm512_loadu_si512 ((const void *) (src + i + 192));
+    _mm512_storeu_si512 ((void *) (dst + i), a);
+    _mm512_storeu_si512 ((void *) (dst + i + 64), b);
+    _mm512_storeu_si512 ((void *) (dst + i + 128), c);
+    _mm512_storeu_si512 ((void *) (dst + i + 192), d);
+  }
+  for (; i + 64 <= n; i += 64)
+    _mm512_storeu_si512 ((void *) (dst + i),
+        _mm512_loadu_si512 ((const void *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("avx512f")))
+static void
+copy_row_nt_avx512 (guint8 * dst, const guint8 * src, gsize n)
+{
+  gsize i = (64 - ((guintptr) dst & 63)) & 63;
+
+  if (i > n)
+    i = n;
+  memcpy (dst, src, i);
+
+  for (; i + 256 <= n; i += 256) {
+    __m512i a = _mm512_loadu_si512 ((const void *) (src + i));
+    __m512i b = _mm512_loadu_si512 ((const void *) (src + i + 64));
+    __m512i c = _mm512_loadu_si512 ((const void *) (src + i + 128));
+    __m512i d = _mm512_loadu_si512 ((const void *) (src + i + 192));
+    _mm512_stream_si512 ((void *) (dst + i), a);
+    _mm512_stream_si512 ((void *) (dst + i + 64), b);
+    _mm512_stream_si512 ((void *) (dst + i + 128), c);
+    _mm512_stream_si512 ((void *) (dst + i + 192), d);
+  }
+  for (; i + 64 <= n; i += 64)
+    _mm512_stream_si512 ((void *) (dst + i),
+        _mm512_loadu_si512 ((const void *) (src + i)));
+  if (i < n)
+    memcpy (dst + i, src + i, n - i);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+interleave_row_sse2 (guint8 * dst, const guint8 * src_a, const guint8 * src_b,
+    gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src_a + i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src_b + i));
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * i), _mm_unpacklo_epi8 (a, b));
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * i + 16),
+        _mm_unpackhi_epi8 (a, b));
+  }
+  if (i < n)
+    interleave_row_c (dst + 2 * i, src_a + i, src_b + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+interleave_row_avx2 (guint8 * dst, const guint8 * src_a, const guint8 * src_b,
+    gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    /* unpack works per 128 bit lane, so first move the quadwords into the
+     * order the lanes consume them in */
+    __m256i a = _mm256_permute4x64_epi64 (_mm256_loadu_si256 ((const __m256i *)
+            (src_a + i)), 0xd8);
+    __m256i b = _mm256_permute4x64_epi64 (_mm256_loadu_si256 ((const __m256i *)
+            (src_b + i)), 0xd8);
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * i),
+        _mm256_unpacklo_epi8 (a, b));
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * i + 32),
+        _mm256_unpackhi_epi8 (a, b));
+  }
+  if (i < n)
+    interleave_row_sse2 (dst + 2 * i, src_a + i, src_b + i, n - i);
+}
+__attribute__ ((target ("sse2")))
+static void
+accumulate_row_u8_sse2 (guint16 * acc, const guint8 * src, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i lo = _mm_loadu_si128 ((const __m128i *) (acc + i));
+    __m128i hi = _mm_loadu_si128 ((const __m128i *) (acc + i + 8));
+    _mm_storeu_si128 ((__m128i *) (acc + i),
+        _mm_add_epi16 (lo, _mm_unpacklo_epi8 (s, zero)));
+    _mm_storeu_si128 ((__m128i *) (acc + i + 8),
+        _mm_add_epi16 (hi, _mm_unpackhi_epi8 (s, zero)));
+  }
+  if (i < n)
+    accumulate_row_u8_c (acc + i, src + i, n - i);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+accumulate_row_u16_sse2 (guint16 * acc, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i s = _mm_loadu_si128 ((const __m128i *) (src + 2 * i));
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (acc + i));
+    _mm_storeu_si128 ((__m128i *) (acc + i), _mm_add_epi16 (a, s));
+  }
+  if (i < n)
+    accumulate_row_u16_c (acc + i, src + 2 * i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+accumulate_row_u8_avx2 (guint16 * acc, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i s = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *)
+            (src + i)));
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (acc + i));
+    _mm256_storeu_si256 ((__m256i *) (acc + i), _mm256_add_epi16 (a, s));
+  }
+  if (i < n)
+    accumulate_row_u8_c (acc + i, src + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+accumulate_row_u16_avx2 (guint16 * acc, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + 2 * i));
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (acc + i));
+    _mm256_storeu_si256 ((__m256i *) (acc + i), _mm256_add_epi16 (a, s));
+  }
+  if (i < n)
+    accumulate_row_u16_c (acc + i, src + 2 * i, n - i);
+}
+
+/* the shifted samples are at most 15 bits, so the signed saturation of the
+ * pack clamps them to 255 */
+__attribute__ ((target ("sse2")))
+static void
+reduce_row_sse2 (guint8 * dst, const guint16 * src, gsize n,
+    const guint16 * offsets, guint shift)
+{
+  const __m128i off = _mm_setr_epi16 (offsets[0], offsets[1], offsets[2],
+      offsets[3], offsets[0], offsets[1], offsets[2], offsets[3]);
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + i + 8));
+    a = _mm_srl_epi16 (_mm_adds_epu16 (a, off), count);
+    b = _mm_srl_epi16 (_mm_adds_epu16 (b, off), count);
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (a, b));
+  }
+  if (i < n)
+    reduce_row_c (dst + i, src + i, n - i, offsets, shift);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+reduce_row_avx2 (guint8 * dst, const guint16 * src, gsize n,
+    const guint16 * offsets, guint shift)
+{
+  const __m256i off = _mm256_setr_epi16 (offsets[0], offsets[1], offsets[2],
+      offsets[3], offsets[0], offsets[1], offsets[2], offsets[3], offsets[0],
+      offsets[1], offsets[2], offsets[3], offsets[0], offsets[1], offsets[2],
+      offsets[3]);
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  gsize i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (src + i + 16));
+    a = _mm256_srl_epi16 (_mm256_adds_epu16 (a, off), count);
+    b = _mm256_srl_epi16 (_mm256_adds_epu16 (b, off), count);
+    /* pack works per 128 bit lane, put the quadwords back in order */
+    _mm256_storeu_si256 ((__m256i *) (dst + i),
+        _mm256_permute4x64_epi64 (_mm256_packus_epi16 (a, b), 0xd8));
+  }
+  if (i < n)
+    reduce_row_sse2 (dst + i, src + i, n - i, offsets, shift);
+}
+#endif /* HAVE_X86_DISPATCH */
+
+static gsize
+query_llc_size (void)
+{
+  glong size = 0;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_LEVEL3_CACHE_SIZE)
+  size = sysconf (_SC_LEVEL3_CACHE_SIZE);
+  if (size <= 0)
+    size = sysconf (_SC_LEVEL2_CACHE_SIZE);
+#endif
+
+  return size > 0 ? (gsize) size : DEFAULT_LLC_SIZE;
+}
+
+/* fills @impl with the kernels of @name if the CPU supports them */
+static gboolean
+copy_impl_setup (CopyImpl * impl, const gchar * name)
+{
+  if (strcmp (name, "c") == 0) {
+    impl->name = "c";
+    impl->copy = copy_row_c;
+    impl->copy_nt = NULL;
+    impl->fence = NULL;
+    impl->interleave = interleave_row_c;
+    impl->accumulate_u8 = accumulate_row_u8_c;
+    impl->accumulate_u16 = accumulate_row_u16_c;
+    impl->reduce = reduce_row_c;
+    return TRUE;
+  }
+#ifdef HAVE_X86_DISPATCH
+  __builtin_cpu_init ();
+  if (strcmp (name, "avx512") == 0 && __builtin_cpu_supports ("avx512f")) {
+    impl->name = "avx512";
+    impl->copy = copy_row_avx512;
+    impl->copy_nt = copy_row_nt_avx512;
+    impl->fence = fence_sse2;
+    impl->interleave = interleave_row_avx2;
+    impl->accumulate_u8 = accumulate_row_u8_avx2;
+    impl->accumulate_u16 = accumulate_row_u16_avx2;
+    impl->reduce = reduce_row_avx2;
+    return TRUE;
+  }
+  if (strcmp (name, "avx2") == 0 && __builtin_cpu_supports ("avx2")) {
+    impl->name = "avx2";
+    impl->copy = copy_row_avx2;
+    impl->copy_nt = copy_row_nt_avx2;
+    impl->fence = fence_sse2;
+    impl->interleave = interleave_row_avx2;
+    impl->accumulate_u8 = accumulate_row_u8_avx2;
+    impl->accumulate_u16 = accumulate_row_u16_avx2;
+    impl->reduce = reduce_row_avx2;
+    return TRUE;
+  }
+  if (strcmp (name, "sse2") == 0 && __builtin_cpu_supports ("sse2")) {
+    impl->name = "sse2";
+    impl->copy = copy_row_sse2;
+    impl->copy_nt = copy_row_nt_sse2;
+    impl->fence = fence_sse2;
+    impl->interleave = interleave_row_sse2;
+    impl->accumulate_u8 = accumulate_row_u8_sse2;
+    impl->accumulate_u16 = accumulate_row_u16_sse2;
+    impl->reduce = reduce_row_sse2;
+    return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+static const CopyImpl *
+gst_openhevc_copy_get_impl (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    guint i;
+
+    /* best first, the C one always works */
+    for (i = 0; gst_openhevc_copy_impl_names[i]; i++) {
+      if (copy_impl_setup (&copy_impl, gst_openhevc_copy_impl_names[i]))
+        break;
+    }
+
+    llc_size = query_llc_size ();
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return &copy_impl;
+}
+
+const gchar *
+gst_openhevc_copy_get_impl_name (void)
+{
+  return gst_openhevc_copy_get_impl ()->name;
+}
+
+/**
+ * gst_openhevc_copy_set_impl:
+ * @name: one of gst_openhevc_copy_impl_names
+ *
+ * Switches all kernels to those of @name, for comparing the implementations
+ * against each other.  Must not be called while anything is being copied.
+ *
+ * Returns: %FALSE if @name is unknown or not supported by this CPU, in which
+ * case the implementation in use is kept
+ */
+gboolean
+gst_openhevc_copy_set_impl (const gchar * name)
+{
+  CopyImpl impl;
+
+  gst_openhevc_copy_get_impl ();
+
+  if (!copy_impl_setup (&impl, name))
+    return FALSE;
+
+  copy_impl = impl;
+
+  return TRUE;
+}
+
+/**
+ * gst_openhevc_copy_use_non_temporal:
+ * @frame_size: number of bytes written per frame
+ *
+ * Returns: whether copying a frame of @frame_size bytes should bypass the
+ * cache, i.e. when it would evict the whole last level cache anyway
+ */
+gboolean
+gst_openhevc_copy_use_non_temporal (gsize frame_size)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+
+  return impl->copy_nt != NULL && frame_size > llc_size;
+}
+
+/**
+ * gst_openhevc_copy_scratch_size:
+ * @width: number of samples per source row
+ *
+ * Returns: the size of the scratch memory the downscale and interleaving
+ *     reduce functions need for rows of @width samples, a multiple of the
+ *     cache line size so that the scratch memory of bands copied in
+ *     parallel doesn't share cache lines
+ */
+gsize
+gst_openhevc_copy_scratch_size (gsize width)
+{
+  /* the 16 bit column sums and two rows of at most @width 8 bit samples */
+  return GST_ROUND_UP_64 (4 * width);
+}
+
+/**
+ * gst_openhevc_copy_plane:
+ * @dst: destination plane
+ * @dst_stride: destination stride in bytes
+ * @src: source plane
+ * @src_stride: source stride in bytes
+ * @row_bytes: number of visible bytes per row, must not exceed either stride
+ * @rows: number of rows
+ * @non_temporal: use streaming stores if available
+ *
+ * Copies the visible part of a plane.
+ */
+void
+gst_openhevc_copy_plane (guint8 * dst, gsize dst_stride, const guint8 * src,
+    gsize src_stride, gsize row_bytes, guint rows, gboolean non_temporal)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  CopyRowFunc copy;
+  guint l;
+
+  if (rows == 0 || row_bytes == 0)
+    return;
+
+  g_return_if_fail (row_bytes <= src_stride && row_bytes <= dst_stride);
+
+  non_temporal = non_temporal && impl->copy_nt != NULL;
+  copy = non_temporal ? impl->copy_nt : impl->copy;
+
+  if (src_stride == dst_stride) {
+    /* same layout, copy everything up to the end of the last visible row in
+     * one go */
+    copy (dst, src, src_stride * (rows - 1) + row_bytes);
+  } else {
+    for (l = 0; l < rows; l++) {
+      copy (dst, src, row_bytes);
+      src += src_stride;
+      dst += dst_stride;
+    }
+  }
+
+  if (non_temporal && impl->fence)
+    impl->fence ();
+}
+
+/**
+ * gst_openhevc_interleave_plane:
+ * @dst: destination semi-planar chroma plane
+ * @dst_stride: destination stride in bytes
+ * @src_a: plane providing the even bytes of each destination row
+ * @src_a_stride: stride of @src_a in bytes
+ * @src_b: plane providing the odd bytes of each destination row
+ * @src_b_stride: stride of @src_b in bytes
+ * @width: number of 8 bit samples per source row
+ * @rows: number of rows
+ *
+ * Interleaves two planes into one, e.g. Cb and Cr into the UV plane of NV12.
+ */
+void
+gst_openhevc_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  guint l;
+
+  g_return_if_fail (2 * width <= dst_stride);
+
+  for (l = 0; l < rows; l++) {
+    impl->interleave (dst, src_a, src_b, width);
+    dst += dst_stride;
+    src_a += src_a_stride;
+    src_b += src_b_stride;
+  }
+}
+
+/* Sums @rows rows of @width samples starting at @src into @acc */
+static void
+accumulate_rows (const CopyImpl * impl, guint16 * acc, const guint8 * src,
+    gsize src_stride, gsize width, guint rows, guint pstride)
+{
+  AccumulateRowFunc accumulate =
+      pstride == 1 ? impl->accumulate_u8 : impl->accumulate_u16;
+  guint r;
+
+  memset (acc, 0, width * sizeof (guint16));
+  for (r = 0; r < rows; r++) {
+    accumulate (acc, src, width);
+    src += src_stride;
+  }
+}
+
+/* Averages each group of @scale accumulated columns of @rows rows, dropping
+ * another @depth_shift bits */
+static void
+downscale_row (guint8 * dst, const guint16 * acc, gsize width, guint rows,
+    guint scale, guint pstride, guint depth_shift)
+{
+  gsize x, out_width = (width + scale - 1) / scale;
+  guint shift =
+      rows == scale ? 2 * g_bit_nth_lsf (scale, -1) + depth_shift : 0;
+
+  for (x = 0; x < out_width; x++) {
+    const guint16 *a = acc + x * scale;
+    guint n = MIN (scale, width - x * scale);
+    guint sum = 0, i, v;
+
+    for (i = 0; i < n; i++)
+      sum += a[i];
+
+    if (shift && n == scale)
+      v = (sum + (1u << (shift - 1))) >> shift;
+    else
+      v = (sum + (n * rows << depth_shift) / 2) / (n * rows << depth_shift);
+
+    if (pstride == 1)
+      dst[x] = MIN (v, 255);
+    else
+      ((guint16 *) dst)[x] = v;
+  }
+}
+
+/**
+ * gst_openhevc_downscale_plane:
+ * @dst: destination plane
+ * @dst_stride: destination stride in bytes
+ * @src: source plane
+ * @src_stride: source stride in bytes
+ * @width: number of samples per source row
+ * @rows: number of source rows
+ * @pstride: bytes per sample, 1 or 2 for up to 12 bits in native endianness
+ * @scale: 2, 4 or 8
+ * @shift: number of low bits to drop, the destination has 8 bit samples
+ *     if not 0
+ * @scratch: gst_openhevc_copy_scratch_size() bytes for @width
+ *
+ * Box filters a plane while copying it, every destination sample is the
+ * rounded average of a @scale x @scale block of the source.  That gives
+ * (@width + @scale - 1) / @scale samples per row and
+ * (@rows + @scale - 1) / @scale rows, the blocks at the right and bottom
+ * edge average only the samples that exist.
+ */
+void
+gst_openhevc_downscale_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src, gsize src_stride, gsize width, guint rows,
+    guint pstride, guint scale, guint shift, guint8 * scratch)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  guint16 *acc = (guint16 *) scratch;
+  guint y, n;
+
+  if (rows == 0 || width == 0)
+    return;
+
+  g_return_if_fail (scale == 2 || scale == 4 || scale == 8);
+  g_return_if_fail (pstride == 1 || pstride == 2);
+  g_return_if_fail (shift == 0 || pstride == 2);
+
+  for (y = 0; y < rows; y += scale) {
+    n = MIN (scale, rows - y);
+    accumulate_rows (impl, acc, src, src_stride, width, n, pstride);
+    downscale_row (dst, acc, width, n, scale, shift ? 1 : pstride, shift);
+    src += n * src_stride;
+    dst += dst_stride;
+  }
+}
+
+/**
+ * gst_openhevc_downscale_interleave_plane:
+ * @dst: destination semi-planar chroma plane
+ * @dst_stride: destination stride in bytes
+ * @src_a: plane providing the even bytes of each destination row
+ * @src_a_stride: stride of @src_a in bytes
+ * @src_b: plane providing the odd bytes of each destination row
+ * @src_b_stride: stride of @src_b in bytes
+ * @width: number of samples per source row
+ * @rows: number of source rows
+ * @pstride: bytes per source sample
+ * @scale: 2, 4 or 8
+ * @shift: number of low bits to drop to get 8 bit samples, 0 for 8 bit
+ *     sources
+ * @scratch: gst_openhevc_copy_scratch_size() bytes for @width
+ *
+ * Like gst_openhevc_downscale_plane() for both planes, interleaving the
+ * results like gst_openhevc_interleave_plane().
+ */
+void
+gst_openhevc_downscale_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows, guint pstride, guint scale,
+    guint shift, guint8 * scratch)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  gsize out_width = (width + scale - 1) / scale;
+  guint16 *acc = (guint16 *) scratch;
+  guint8 *tmp = scratch + width * sizeof (guint16);
+  guint y, n;
+
+  if (rows == 0 || width == 0)
+    return;
+
+  g_return_if_fail (scale == 2 || scale == 4 || scale == 8);
+  g_return_if_fail ((pstride == 1 && shift == 0) || pstride == 2);
+  g_return_if_fail (2 * out_width <= dst_stride);
+
+  for (y = 0; y < rows; y += scale) {
+    n = MIN (scale, rows - y);
+    accumulate_rows (impl, acc, src_a, src_a_stride, width, n, pstride);
+    downscale_row (tmp, acc, width, n, scale, 1, shift);
+    accumulate_rows (impl, acc, src_b, src_b_stride, width, n, pstride);
+    downscale_row (tmp + out_width, acc, width, n, scale, 1, shift);
+    impl->interleave (dst, tmp, tmp + out_width, out_width);
+    src_a += n * src_a_stride;
+    src_b += n * src_b_stride;
+    dst += dst_stride;
+  }
+}
+
+/* rounding, or ordered dither thresholds for @row of the picture */
+static void
+reduce_offsets (guint16 * offsets, guint shift, gboolean dither, guint row)
+{
+  guint x;
+
+  for (x = 0; x < 4; x++) {
+    if (dither)
+      offsets[x] = (bayer_4x4[row & 3][x] << shift) >> 4;
+    else
+      offsets[x] = 1 << (shift - 1);
+  }
+}
+
+/**
+ * gst_openhevc_reduce_plane:
+ * @dst: destination plane with 8 bit samples
+ * @dst_stride: destination stride in bytes
+ * @src: source plane with 16 bit samples in native endianness
+ * @src_stride: source stride in bytes
+ * @width: number of samples per row
+ * @rows: number of rows
+ * @shift: number of low bits to drop, the bit depth of the source minus 8
+ * @dither: apply a 4x4 ordered dither instead of rounding
+ * @first_row: row of the picture @src starts at, for the dither pattern
+ *
+ * Reduces the bit depth of a plane while copying it.
+ */
+void
+gst_openhevc_reduce_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src, gsize src_stride, gsize width, guint rows,
+    guint shift, gboolean dither, guint first_row)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  guint16 offsets[4];
+  guint l;
+
+  g_return_if_fail (shift >= 1 && shift <= 8);
+  g_return_if_fail (width <= dst_stride);
+
+  for (l = 0; l < rows; l++) {
+    reduce_offsets (offsets, shift, dither, first_row + l);
+    impl->reduce (dst, (const guint16 *) src, width, offsets, shift);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+/**
+ * gst_openhevc_reduce_interleave_plane:
+ * @dst: destination semi-planar chroma plane with 8 bit samples
+ * @dst_stride: destination stride in bytes
+ * @src_a: plane providing the even bytes of each destination row
+ * @src_a_stride: stride of @src_a in bytes
+ * @src_b: plane providing the odd bytes of each destination row
+ * @src_b_stride: stride of @src_b in bytes
+ * @width: number of 16 bit samples per source row
+ * @rows: number of rows
+ * @shift: number of low bits to drop, the bit depth of the source minus 8
+ * @dither: apply a 4x4 ordered dither instead of rounding
+ * @first_row: row of the picture the sources start at
+ * @scratch: gst_openhevc_copy_scratch_size() bytes for @width
+ *
+ * Like gst_openhevc_reduce_plane() for both planes, interleaving the
+ * results like gst_openhevc_interleave_plane().
+ */
+void
+gst_openhevc_reduce_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows, guint shift,
+    gboolean dither, guint first_row, guint8 * scratch)
+{
+  const CopyImpl *impl = gst_openhevc_copy_get_impl ();
+  guint16 offsets[4];
+  /* stays in the L1 cache between the two passes */
+  guint8 *tmp = scratch;
+  guint l;
+
+  if (rows == 0 || width == 0)
+    return;
+
+  g_return_if_fail (shift >= 1 && shift <= 8);
+  g_return_if_fail (2 * width <= dst_stride);
+
+  for (l = 0; l < rows; l++) {
+    reduce_offsets (offsets, shift, dither, first_row + l);
+    impl->reduce (tmp, (const guint16 *) src_a, width, offsets, shift);
+    impl->reduce (tmp + width, (const guint16 *) src_b, width, offsets,
+        shift);
+    impl->interleave (dst, tmp, tmp + width, width);
+    src_a += src_a_stride;
+    src_b += src_b_stride;
+    dst += dst_stride;
+  }
+}
@@ -0,0 +1,66 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_COPY_H__
+#define __GST_OPENHEVC_COPY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* all implementations, best first */
+extern const gchar *const gst_openhevc_copy_impl_names[];
+
+const gchar * gst_openhevc_copy_get_impl_name (void);
+
+gboolean gst_openhevc_copy_set_impl (const gchar * name);
+
+gboolean gst_openhevc_copy_use_non_temporal (gsize frame_size);
+
+gsize gst_openhevc_copy_scratch_size (gsize width);
+
+void gst_openhevc_copy_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src, gsize src_stride, gsize row_bytes, guint rows,
+    gboolean non_temporal);
+
+void gst_openhevc_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows);
+
+void gst_openhevc_downscale_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src, gsize src_stride, gsize width, guint rows,
+    guint pstride, guint scale, guint shift, guint8 * scratch);
+
+void gst_openhevc_downscale_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows, guint pstride, guint scale,
+    guint shift, guint8 * scratch);
+
+void gst_openhevc_reduce_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src, gsize src_stride, gsize width, guint rows,
+    guint shift, gboolean dither, guint first_row);
+
+void gst_openhevc_reduce_interleave_plane (guint8 * dst, gsize dst_stride,
+    const guint8 * src_a, gsize src_a_stride, const guint8 * src_b,
+    gsize src_b_stride, gsize width, guint rows, guint shift,
+    gboolean dither, guint first_row, guint8 * scratch);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_COPY_H__ */
@@ -0,0 +1,141 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstopenhevcframetable.h"
+
+#define FRAME_TABLE_MASK (GST_OPENHEVC_FRAME_TABLE_SIZE - 1)
+
+/* system_frame_number wraps around */
+#define SEQNUM_DIFF(a,b) ((gint32) ((guint32) (a) - (guint32) (b)))
+
+void
+gst_openhevc_frame_table_init (GstOpenHEVCFrameTable * table)
+{
+  memset (table, 0, sizeof (*table));
+}
+
+/* drops all references held by the table */
+void
+gst_openhevc_frame_table_clear (GstOpenHEVCFrameTable * table)
+{
+  guint i;
+
+  for (i = 0; i < GST_OPENHEVC_FRAME_TABLE_SIZE && table->n_frames > 0; i++) {
+    if (table->frames[i]) {
+      gst_video_codec_frame_unref (table->frames[i]);
+      table->frames[i] = NULL;
+      table->n_frames--;
+    }
+  }
+
+  table->n_frames = 0;
+  table->oldest = 0;
+}
+
+/**
+ * gst_openhevc_frame_table_insert:
+ * @table: a #GstOpenHEVCFrameTable
+ * @frame: (transfer none): the frame to add
+ *
+ * Returns: (transfer full) (nullable): a frame at least
+ * %GST_OPENHEVC_FRAME_TABLE_SIZE frames older than @frame that had to be
+ * evicted to make room
+ */
+GstVideoCodecFrame *
+gst_openhevc_frame_table_insert (GstOpenHEVCFrameTable * table,
+    GstVideoCodecFrame * frame)
+{
+  guint slot = frame->system_frame_number & FRAME_TABLE_MASK;
+  GstVideoCodecFrame *evicted = table->frames[slot];
+
+  if (table->n_frames == 0
+      || SEQNUM_DIFF (frame->system_frame_number, table->oldest) < 0)
+    table->oldest = frame->system_frame_number;
+
+  if (evicted)
+    table->n_frames--;
+
+  table->frames[slot] = gst_video_codec_frame_ref (frame);
+  table->n_frames++;
+
+  return evicted;
+}
+
+/**
+ * gst_openhevc_frame_table_take:
+ * @table: a #GstOpenHEVCFrameTable
+ * @system_frame_number: the frame to look up
+ *
+ * Returns: (transfer full) (nullable): the frame with @system_frame_number,
+ * removed from @table
+ */
+GstVideoCodecFrame *
+gst_openhevc_frame_table_take (GstOpenHEVCFrameTable * table,
+    guint32 system_frame_number)
+{
+  guint slot = system_frame_number & FRAME_TABLE_MASK;
+  GstVideoCodecFrame *frame = table->frames[slot];
+
+  if (frame == NULL || frame->system_frame_number != system_frame_number)
+    return NULL;
+
+  table->frames[slot] = NULL;
+  table->n_frames--;
+
+  return frame;
+}
+
+/**
+ * gst_openhevc_frame_table_pop_older:
+ * @table: a #GstOpenHEVCFrameTable
+ * @system_frame_number: limit
+ *
+ * Removes the oldest frame with a system_frame_number lower than
+ * @system_frame_number.  Call repeatedly until it returns %NULL to remove
+ * all of them.  Every slot is only visited once over the lifetime of the
+ * table so this is constant time per inserted frame.
+ *
+ * Returns: (transfer full) (nullable): the removed frame
+ */
+GstVideoCodecFrame *
+gst_openhevc_frame_table_pop_older (GstOpenHEVCFrameTable * table,
+    guint32 system_frame_number)
+{
+  while (table->n_frames > 0
+      && SEQNUM_DIFF (system_frame_number, table->oldest) > 0) {
+    guint slot = table->oldest & FRAME_TABLE_MASK;
+    GstVideoCodecFrame *frame = table->frames[slot];
+
+    table->oldest++;
+
+    if (frame && SEQNUM_DIFF (frame->system_frame_number, table->oldest) < 0) {
+      table->frames[slot] = NULL;
+      table->n_frames--;
+      return frame;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,63 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_FRAME_TABLE_H__
+#define __GST_OPENHEVC_FRAME_TABLE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* must be a power of two */
+#define GST_OPENHEVC_FRAME_TABLE_SIZE 256
+
+typedef struct _GstOpenHEVCFrameTable GstOpenHEVCFrameTable;
+
+/**
+ * GstOpenHEVCFrameTable:
+ *
+ * Frames handed to the decoder that haven't been output yet, indexed by
+ * their system_frame_number which is passed through OpenHEVC in place of
+ * the pts.  Holds a reference to every frame.
+ */
+struct _GstOpenHEVCFrameTable
+{
+  GstVideoCodecFrame *frames[GST_OPENHEVC_FRAME_TABLE_SIZE];
+  guint n_frames;
+  /* lowest system_frame_number that might still be in the table */
+  guint32 oldest;
+};
+
+void gst_openhevc_frame_table_init (GstOpenHEVCFrameTable * table);
+
+void gst_openhevc_frame_table_clear (GstOpenHEVCFrameTable * table);
+
+GstVideoCodecFrame * gst_openhevc_frame_table_insert (GstOpenHEVCFrameTable * table,
+    GstVideoCodecFrame * frame);
+
+GstVideoCodecFrame * gst_openhevc_frame_table_take (GstOpenHEVCFrameTable * table,
+    guint32 system_frame_number);
+
+GstVideoCodecFrame * gst_openhevc_frame_table_pop_older (GstOpenHEVCFrameTable * table,
+    guint32 system_frame_number);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_FRAME_TABLE_H__ */
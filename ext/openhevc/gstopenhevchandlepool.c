@@ -0,0 +1,198 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstopenhevchandlepool.h"
+#include "gstopenhevc.h"
+
+#define IDLE_TIME_US \
+    ((gint64) (GST_OPENHEVC_HANDLE_POOL_IDLE_TIME / GST_USECOND))
+
+/*
+ * Creating an OpenHEVC handle spawns its worker threads and sets up its
+ * tables, which is a noticeable part of the startup time of short lived
+ * pipelines.  Decoders with reuse-handles enabled hand their flushed, still
+ * started handles to this pool instead of destroying them so the next such
+ * decoder with the same threading configuration and CPU affinity can
+ * continue with it.
+ *
+ * oh_close() joins the worker threads, so evicted handles and those idle for
+ * longer than GST_OPENHEVC_HANDLE_POOL_IDLE_TIME are closed on a dedicated
+ * reaper thread.  It only exists while there are handles in the pool.
+ */
+
+typedef struct
+{
+  OHHandle handle;
+  gint n_threads;
+  gint thread_type;
+  /* CPUs the worker threads are bound to, NULL if unrestricted */
+  gchar *cpus;
+  /* monotonic time */
+  gint64 idle_since;
+} PooledHandle;
+
+static GMutex pool_lock;
+static GCond pool_cond;
+/* most recently released first */
+static GQueue pool = G_QUEUE_INIT;
+/* evicted handles waiting for the reaper */
+static GList *to_close;
+static gboolean reaper_running;
+
+static void
+pooled_handle_close (PooledHandle * pooled)
+{
+  GST_DEBUG ("closing idle OpenHEVC handle %p", pooled->handle);
+  oh_close (pooled->handle);
+  g_free (pooled->cpus);
+  g_slice_free (PooledHandle, pooled);
+}
+
+static gpointer
+gst_openhevc_handle_pool_reaper (gpointer user_data)
+{
+  PooledHandle *pooled;
+  GList *closing;
+  gint64 now;
+
+  g_mutex_lock (&pool_lock);
+  for (;;) {
+    /* the oldest ones are at the tail */
+    now = g_get_monotonic_time ();
+    while ((pooled = g_queue_peek_tail (&pool))
+        && now - pooled->idle_since >= IDLE_TIME_US)
+      to_close = g_list_prepend (to_close, g_queue_pop_tail (&pool));
+
+    if (to_close) {
+      closing = to_close;
+      to_close = NULL;
+      /* joins the decoder threads, don't block others meanwhile */
+      g_mutex_unlock (&pool_lock);
+      g_list_free_full (closing, (GDestroyNotify) pooled_handle_close);
+      g_mutex_lock (&pool_lock);
+      continue;
+    }
+
+    if (pooled == NULL)
+      break;
+
+    g_cond_wait_until (&pool_cond, &pool_lock,
+        pooled->idle_since + IDLE_TIME_US);
+  }
+  reaper_running = FALSE;
+  g_mutex_unlock (&pool_lock);
+
+  GST_DEBUG ("handle pool is empty, reaper thread exiting");
+
+  return NULL;
+}
+
+/* with pool_lock */
+static void
+gst_openhevc_handle_pool_wake_reaper (void)
+{
+  GThread *thread;
+
+  if (reaper_running) {
+    g_cond_signal (&pool_cond);
+    return;
+  }
+
+  thread = g_thread_new ("openhevc-reaper", gst_openhevc_handle_pool_reaper,
+      NULL);
+  g_thread_unref (thread);
+  reaper_running = TRUE;
+}
+
+/**
+ * gst_openhevc_handle_pool_acquire:
+ * @n_threads: number of decoder threads
+ * @thread_type: OpenHEVC thread type
+ * @cpus: (nullable): normalized list of CPUs the decoder threads are bound to
+ *
+ * Returns: (nullable): a started, flushed handle created with the given
+ * threading configuration, or %NULL if there is none idle
+ */
+OHHandle
+gst_openhevc_handle_pool_acquire (gint n_threads, gint thread_type,
+    const gchar * cpus)
+{
+  OHHandle handle = NULL;
+  GList *l;
+
+  g_mutex_lock (&pool_lock);
+  for (l = pool.head; l; l = l->next) {
+    PooledHandle *pooled = l->data;
+
+    if (pooled->n_threads == n_threads && pooled->thread_type == thread_type
+        && g_strcmp0 (pooled->cpus, cpus) == 0) {
+      handle = pooled->handle;
+      g_queue_delete_link (&pool, l);
+      g_free (pooled->cpus);
+      g_slice_free (PooledHandle, pooled);
+      /* let the reaper exit if that was the last one */
+      g_cond_signal (&pool_cond);
+      break;
+    }
+  }
+  g_mutex_unlock (&pool_lock);
+
+  if (handle)
+    GST_DEBUG ("reusing idle OpenHEVC handle %p", handle);
+
+  return handle;
+}
+
+/**
+ * gst_openhevc_handle_pool_release:
+ * @handle: a started handle no picture of which is referenced anymore and
+ *     that didn't run into decoding errors
+ * @n_threads: number of decoder threads @handle was created with
+ * @thread_type: OpenHEVC thread type @handle was created with
+ * @cpus: (nullable): CPUs the threads of @handle are bound to
+ *
+ * Flushes @handle and keeps it for reuse.  If the pool is full already, the
+ * least recently used handle gets closed.
+ */
+void
+gst_openhevc_handle_pool_release (OHHandle handle, gint n_threads,
+    gint thread_type, const gchar * cpus)
+{
+  PooledHandle *pooled;
+
+  oh_flush (handle);
+
+  pooled = g_slice_new (PooledHandle);
+  pooled->handle = handle;
+  pooled->n_threads = n_threads;
+  pooled->thread_type = thread_type;
+  pooled->cpus = g_strdup (cpus);
+  pooled->idle_since = g_get_monotonic_time ();
+
+  g_mutex_lock (&pool_lock);
+  g_queue_push_head (&pool, pooled);
+  if (g_queue_get_length (&pool) > GST_OPENHEVC_HANDLE_POOL_MAX_IDLE)
+    to_close = g_list_prepend (to_close, g_queue_pop_tail (&pool));
+  gst_openhevc_handle_pool_wake_reaper ();
+  g_mutex_unlock (&pool_lock);
+}
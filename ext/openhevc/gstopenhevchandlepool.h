@@ -0,0 +1,40 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_HANDLE_POOL_H__
+#define __GST_OPENHEVC_HANDLE_POOL_H__
+
+#include <gst/gst.h>
+#include <libopenhevc/openhevc.h>
+
+G_BEGIN_DECLS
+
+/* idle handles kept around process wide, and for how long */
+#define GST_OPENHEVC_HANDLE_POOL_MAX_IDLE 4
+#define GST_OPENHEVC_HANDLE_POOL_IDLE_TIME (30 * GST_SECOND)
+
+OHHandle gst_openhevc_handle_pool_acquire (gint n_threads, gint thread_type,
+    const gchar * cpus);
+
+void gst_openhevc_handle_pool_release (OHHandle handle, gint n_threads,
+    gint thread_type, const gchar * cpus);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_HANDLE_POOL_H__ */
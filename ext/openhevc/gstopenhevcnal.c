@@ -0,0 +1,166 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstopenhevcnal.h"
+
+const guint8 gst_openhevc_nal_start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+/* Unpacks the parameter sets stored in a HEVCDecoderConfigurationRecord
+ * into Annex B byte-stream format.  Returns NULL if the record is
+ * truncated */
+GByteArray *
+gst_openhevc_nal_parse_hvcc (const guint8 * data, gsize size,
+    guint * nal_length_size)
+{
+  GByteArray *ps;
+  guint num_arrays, i, j;
+  gsize pos;
+
+  if (size < 23)
+    return NULL;
+
+  num_arrays = data[22];
+  pos = 23;
+
+  ps = g_byte_array_new ();
+  for (i = 0; i < num_arrays; i++) {
+    guint num_nals;
+
+    if (pos + 3 > size)
+      goto truncated;
+    num_nals = GST_READ_UINT16_BE (data + pos + 1);
+    pos += 3;
+
+    for (j = 0; j < num_nals; j++) {
+      guint nal_size;
+
+      if (pos + 2 > size)
+        goto truncated;
+      nal_size = GST_READ_UINT16_BE (data + pos);
+      pos += 2;
+      if (nal_size > size - pos)
+        goto truncated;
+
+      g_byte_array_append (ps, gst_openhevc_nal_start_code,
+          sizeof (gst_openhevc_nal_start_code));
+      g_byte_array_append (ps, data + pos, nal_size);
+      pos += nal_size;
+    }
+  }
+
+  *nal_length_size = (data[21] & 0x03) + 1;
+
+  return ps;
+
+truncated:
+  {
+    g_byte_array_unref (ps);
+    return NULL;
+  }
+}
+
+static guint32
+_read_nal_length (const guint8 * data, guint nal_length_size)
+{
+  switch (nal_length_size) {
+    case 1:
+      return data[0];
+    case 2:
+      return GST_READ_UINT16_BE (data);
+    case 3:
+      return GST_READ_UINT24_BE (data);
+    default:
+      return GST_READ_UINT32_BE (data);
+  }
+}
+
+/* Replaces the 4 byte length prefixes of an access unit by start codes.
+ * Returns FALSE if a length runs past the end of @data, which is then only
+ * partially converted */
+gboolean
+gst_openhevc_nal_to_byte_stream_in_place (guint8 * data, gsize size)
+{
+  gsize pos = 0;
+
+  while (pos < size) {
+    guint32 nal_size;
+
+    if (size - pos < 4)
+      return FALSE;
+    nal_size = GST_READ_UINT32_BE (data + pos);
+    if (nal_size > size - pos - 4)
+      return FALSE;
+
+    memcpy (data + pos, gst_openhevc_nal_start_code, 4);
+    pos += 4 + nal_size;
+  }
+
+  return TRUE;
+}
+
+/* Size of an access unit with @nal_length_size byte length prefixes once
+ * converted to byte-stream format.  Returns FALSE if a length runs past the
+ * end of @data */
+gboolean
+gst_openhevc_nal_byte_stream_size (const guint8 * data, gsize size,
+    guint nal_length_size, gsize * out_size)
+{
+  gsize pos = 0, len = 0;
+
+  while (pos < size) {
+    guint32 nal_size;
+
+    if (size - pos < nal_length_size)
+      return FALSE;
+    nal_size = _read_nal_length (data + pos, nal_length_size);
+    if (nal_size > size - pos - nal_length_size)
+      return FALSE;
+
+    len += 4 + nal_size;
+    pos += nal_length_size + nal_size;
+  }
+
+  *out_size = len;
+
+  return TRUE;
+}
+
+/* Converts an access unit validated by gst_openhevc_nal_byte_stream_size()
+ * into byte-stream format at @out */
+void
+gst_openhevc_nal_to_byte_stream (const guint8 * data, gsize size,
+    guint nal_length_size, guint8 * out)
+{
+  gsize pos = 0;
+
+  while (pos < size) {
+    guint32 nal_size = _read_nal_length (data + pos, nal_length_size);
+
+    memcpy (out, gst_openhevc_nal_start_code, 4);
+    memcpy (out + 4, data + pos + nal_length_size, nal_size);
+    out += 4 + nal_size;
+    pos += nal_length_size + nal_size;
+  }
+}
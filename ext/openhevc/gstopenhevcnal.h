@@ -0,0 +1,43 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_NAL_H__
+#define __GST_OPENHEVC_NAL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+extern const guint8 gst_openhevc_nal_start_code[4];
+
+GByteArray *gst_openhevc_nal_parse_hvcc (const guint8 * data, gsize size,
+    guint * nal_length_size);
+
+gboolean gst_openhevc_nal_to_byte_stream_in_place (guint8 * data,
+    gsize size);
+
+gboolean gst_openhevc_nal_byte_stream_size (const guint8 * data, gsize size,
+    guint nal_length_size, gsize * out_size);
+
+void gst_openhevc_nal_to_byte_stream (const guint8 * data, gsize size,
+    guint nal_length_size, guint8 * out);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_NAL_H__ */
@@ -0,0 +1,383 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Turning the decoded pictures into output frames: which format to output
+ * and the per plane copy jobs producing it.  Kept apart from the element
+ * so that tests/benchmarks runs exactly this code. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstopenhevcoutput.h"
+#include "gstopenhevccopy.h"
+#include "gstopenhevc.h"
+
+struct _GstOpenHEVCCopyBarrier
+{
+  GMutex lock;
+  GCond cond;
+  guint pending;
+};
+
+/* Formats the native decoder output can be converted to while copying it
+ * out, the native one first */
+static const GstVideoFormat i420_output_formats[] = {
+  GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_NV21,
+};
+
+static gboolean
+_output_format_is_candidate (GstVideoFormat format)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (i420_output_formats); i++) {
+    if (i420_output_formats[i] == format)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static GstVideoFormat
+_first_candidate_format (const GValue * formats)
+{
+  GstVideoFormat format = GST_VIDEO_FORMAT_UNKNOWN;
+  guint i;
+
+  if (G_VALUE_HOLDS_STRING (formats)) {
+    format = gst_video_format_from_string (g_value_get_string (formats));
+    if (_output_format_is_candidate (format))
+      return format;
+  } else if (GST_VALUE_HOLDS_LIST (formats)) {
+    for (i = 0; i < gst_value_list_get_size (formats); i++) {
+      format = _first_candidate_format (gst_value_list_get_value (formats, i));
+      if (format != GST_VIDEO_FORMAT_UNKNOWN)
+        return format;
+    }
+  }
+
+  return GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+/**
+ * gst_openhevc_output_choose_format:
+ * @native: format of the decoded pictures
+ * @depth: output-depth, 0 to keep that of @native
+ * @allowed: (nullable): caps downstream allows
+ *
+ * Returns: the format downstream prefers among the ones the output copy can
+ * produce from @native
+ */
+GstVideoFormat
+gst_openhevc_output_choose_format (GstVideoFormat native, guint depth,
+    GstCaps * allowed)
+{
+  GstVideoFormat format;
+  guint i;
+
+  /* the output copy reduces the depth, which opens up the 8 bit formats */
+  if (depth == 8 && native == GST_VIDEO_FORMAT_I420_10LE)
+    native = GST_VIDEO_FORMAT_I420;
+
+  if (native != GST_VIDEO_FORMAT_I420 || !allowed)
+    return native;
+
+  for (i = 0; i < gst_caps_get_size (allowed); i++) {
+    const GValue *formats =
+        gst_structure_get_value (gst_caps_get_structure (allowed, i), "format");
+
+    if (formats) {
+      format = _first_candidate_format (formats);
+      if (format != GST_VIDEO_FORMAT_UNKNOWN)
+        return format;
+    }
+  }
+
+  return native;
+}
+
+/**
+ * gst_openhevc_output_build_jobs:
+ * @jobs: (out caller-allocates): one job per plane of @dst_frame
+ * @dst_frame: mapped output frame
+ * @src_info: format and size of the decoded picture
+ * @src: the planes of the decoded picture
+ * @src_stride: their strides
+ * @scale: output-scale
+ * @dither: dither when reducing the depth at full size
+ *
+ * The size of @dst_frame is that of @src_info divided by @scale, its format
+ * one returned by gst_openhevc_output_choose_format() for that of
+ * @src_info.
+ *
+ * Returns: the number of jobs
+ */
+guint
+gst_openhevc_output_build_jobs (GstOpenHEVCCopyJob * jobs,
+    GstVideoFrame * dst_frame, const GstVideoInfo * src_info,
+    const guint8 * const src[3], const gsize src_stride[3], guint scale,
+    gboolean dither)
+{
+  gboolean non_temporal;
+  guint shift;
+  guint p;
+
+  /* frames that don't fit into the cache anyway would only evict everything
+   * else from it */
+  non_temporal =
+      gst_openhevc_copy_use_non_temporal (GST_VIDEO_INFO_SIZE
+      (&dst_frame->info));
+
+  /* output-depth */
+  shift = GST_VIDEO_INFO_COMP_DEPTH (src_info, 0) -
+      GST_VIDEO_FRAME_COMP_DEPTH (dst_frame, 0);
+
+  for (p = 0; p < GST_VIDEO_FRAME_N_PLANES (dst_frame); p++) {
+    GstOpenHEVCCopyJob *job = &jobs[p];
+    /* first component stored in this plane */
+    guint comp = p;
+
+    job->op = GST_OPENHEVC_COPY_PLANE;
+    job->dst = GST_VIDEO_FRAME_PLANE_DATA (dst_frame, p);
+    job->dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dst_frame, p);
+    job->src = src[comp];
+    job->src_stride = src_stride[comp];
+    job->src2 = NULL;
+    job->src2_stride = 0;
+    job->rows = GST_VIDEO_FRAME_COMP_HEIGHT (dst_frame, comp);
+    job->src_rows = GST_VIDEO_INFO_COMP_HEIGHT (src_info, comp);
+    job->scale = scale;
+    job->pstride = GST_VIDEO_INFO_COMP_PSTRIDE (src_info, comp);
+    job->row_bytes = GST_VIDEO_INFO_COMP_WIDTH (src_info, comp) *
+        job->pstride;
+    job->shift = shift;
+    job->dither = dither;
+    job->row = 0;
+    job->non_temporal = non_temporal;
+    job->scratch = NULL;
+    job->barrier = NULL;
+
+    if (scale > 1)
+      job->op = GST_OPENHEVC_COPY_DOWNSCALE;
+    else if (shift > 0)
+      job->op = GST_OPENHEVC_COPY_REDUCE;
+
+    if (p == 1 && GST_VIDEO_FRAME_N_PLANES (dst_frame) == 2) {
+      /* semi-planar: Cb and Cr (or Cr and Cb for NV21) interleaved */
+      gboolean swap =
+          GST_VIDEO_FRAME_FORMAT (dst_frame) == GST_VIDEO_FORMAT_NV21;
+
+      if (scale > 1)
+        job->op = GST_OPENHEVC_COPY_DOWNSCALE_INTERLEAVE;
+      else if (shift > 0)
+        job->op = GST_OPENHEVC_COPY_REDUCE_INTERLEAVE;
+      else
+        job->op = GST_OPENHEVC_COPY_INTERLEAVE;
+      job->src = src[swap ? 2 : 1];
+      job->src_stride = src_stride[swap ? 2 : 1];
+      job->src2 = src[swap ? 1 : 2];
+      job->src2_stride = src_stride[swap ? 1 : 2];
+      job->row_bytes = GST_VIDEO_INFO_COMP_WIDTH (src_info, 1) *
+          job->pstride;
+    }
+  }
+
+  return p;
+}
+
+static void
+gst_openhevc_output_run_job (GstOpenHEVCCopyJob * job)
+{
+  switch (job->op) {
+    case GST_OPENHEVC_COPY_PLANE:
+      gst_openhevc_copy_plane (job->dst, job->dst_stride, job->src,
+          job->src_stride, job->row_bytes, job->rows, job->non_temporal);
+      break;
+    case GST_OPENHEVC_COPY_INTERLEAVE:
+      gst_openhevc_interleave_plane (job->dst, job->dst_stride, job->src,
+          job->src_stride, job->src2, job->src2_stride, job->row_bytes,
+          job->rows);
+      break;
+    case GST_OPENHEVC_COPY_DOWNSCALE:
+      gst_openhevc_downscale_plane (job->dst, job->dst_stride, job->src,
+          job->src_stride, job->row_bytes / job->pstride, job->src_rows,
+          job->pstride, job->scale, job->shift, job->scratch);
+      break;
+    case GST_OPENHEVC_COPY_DOWNSCALE_INTERLEAVE:
+      gst_openhevc_downscale_interleave_plane (job->dst, job->dst_stride,
+          job->src, job->src_stride, job->src2, job->src2_stride,
+          job->row_bytes / job->pstride, job->src_rows, job->pstride,
+          job->scale, job->shift, job->scratch);
+      break;
+    case GST_OPENHEVC_COPY_REDUCE:
+      gst_openhevc_reduce_plane (job->dst, job->dst_stride, job->src,
+          job->src_stride, job->row_bytes / job->pstride, job->rows,
+          job->shift, job->dither, job->row);
+      break;
+    case GST_OPENHEVC_COPY_REDUCE_INTERLEAVE:
+      gst_openhevc_reduce_interleave_plane (job->dst, job->dst_stride,
+          job->src, job->src_stride, job->src2, job->src2_stride,
+          job->row_bytes / job->pstride, job->rows, job->shift,
+          job->dither, job->row, job->scratch);
+      break;
+  }
+
+  if (job->barrier) {
+    g_mutex_lock (&job->barrier->lock);
+    if (--job->barrier->pending == 0)
+      g_cond_signal (&job->barrier->cond);
+    g_mutex_unlock (&job->barrier->lock);
+  }
+}
+
+static gsize
+_job_scratch_size (const GstOpenHEVCCopyJob * job)
+{
+  switch (job->op) {
+    case GST_OPENHEVC_COPY_DOWNSCALE:
+    case GST_OPENHEVC_COPY_DOWNSCALE_INTERLEAVE:
+    case GST_OPENHEVC_COPY_REDUCE_INTERLEAVE:
+      return gst_openhevc_copy_scratch_size (job->row_bytes / job->pstride);
+    default:
+      return 0;
+  }
+}
+
+/* cache line aligned, so that no two bands share one */
+static guint8 *
+_alloc_scratch (gsize size, guint8 ** mem)
+{
+  if (size == 0) {
+    *mem = NULL;
+    return NULL;
+  }
+
+  *mem = g_malloc (size + 63);
+  return (guint8 *) (((guintptr) * mem + 63) & ~((guintptr) 63));
+}
+
+/**
+ * gst_openhevc_output_run_jobs:
+ * @jobs: jobs from gst_openhevc_output_build_jobs()
+ * @n_jobs: number of @jobs
+ * @pool: (nullable): pool to run bands of the jobs on
+ * @n_bands: number of bands to split each job into, at most
+ *     GST_OPENHEVC_OUTPUT_MAX_BANDS
+ *
+ * Executes @jobs, in parallel bands of rows if @pool is given.  The first
+ * band is run by the calling thread itself.  The scratch memory of all
+ * bands is allocated at once.
+ *
+ * Returns: the number of bands the jobs were split into
+ */
+guint
+gst_openhevc_output_run_jobs (GstOpenHEVCCopyJob * jobs, guint n_jobs,
+    GstTaskPool * pool, guint n_bands)
+{
+  GstOpenHEVCCopyJob bands[GST_VIDEO_MAX_PLANES *
+      GST_OPENHEVC_OUTPUT_MAX_BANDS];
+  GstOpenHEVCCopyBarrier barrier;
+  guint8 *scratch, *scratch_mem;
+  gsize scratch_size = 0;
+  guint n_split = 0;
+  guint i, b;
+
+  g_return_val_if_fail (n_jobs <= GST_VIDEO_MAX_PLANES, 0);
+
+  n_bands = MIN (n_bands, GST_OPENHEVC_OUTPUT_MAX_BANDS);
+
+  if (!pool || n_bands <= 1) {
+    /* one after the other, so they can all use the same */
+    for (i = 0; i < n_jobs; i++)
+      scratch_size = MAX (scratch_size, _job_scratch_size (&jobs[i]));
+    scratch = _alloc_scratch (scratch_size, &scratch_mem);
+
+    for (i = 0; i < n_jobs; i++) {
+      GstOpenHEVCCopyJob job = jobs[i];
+
+      job.scratch = scratch;
+      gst_openhevc_output_run_job (&job);
+    }
+
+    g_free (scratch_mem);
+    return n_jobs;
+  }
+
+  for (i = 0; i < n_jobs; i++) {
+    guint rows_per_band = (jobs[i].rows + n_bands - 1) / n_bands;
+    guint row = 0;
+
+    for (b = 0; b < n_bands && row < jobs[i].rows; b++) {
+      GstOpenHEVCCopyJob *band = &bands[n_split++];
+
+      *band = jobs[i];
+      band->dst += row * jobs[i].dst_stride;
+      band->src += row * jobs[i].scale * jobs[i].src_stride;
+      if (band->src2)
+        band->src2 += row * jobs[i].scale * jobs[i].src2_stride;
+      band->rows = MIN (rows_per_band, jobs[i].rows - row);
+      band->src_rows = MIN (band->rows * jobs[i].scale,
+          jobs[i].src_rows - row * jobs[i].scale);
+      band->row = jobs[i].row + row;
+      band->barrier = &barrier;
+      row += band->rows;
+      scratch_size += _job_scratch_size (band);
+    }
+  }
+
+  scratch = _alloc_scratch (scratch_size, &scratch_mem);
+  for (i = 0; i < n_split; i++) {
+    gsize size = _job_scratch_size (&bands[i]);
+
+    if (size > 0) {
+      bands[i].scratch = scratch;
+      scratch += size;
+    }
+  }
+
+  g_mutex_init (&barrier.lock);
+  g_cond_init (&barrier.cond);
+  barrier.pending = n_split;
+
+  /* the first band is copied by the calling thread itself */
+  for (i = 1; i < n_split; i++) {
+    GError *error = NULL;
+
+    gst_task_pool_push (pool, (GstTaskPoolFunction)
+        gst_openhevc_output_run_job, &bands[i], &error);
+    if (error) {
+      GST_WARNING ("Failed to push copy job: %s", error->message);
+      g_clear_error (&error);
+      gst_openhevc_output_run_job (&bands[i]);
+    }
+  }
+  gst_openhevc_output_run_job (&bands[0]);
+
+  g_mutex_lock (&barrier.lock);
+  while (barrier.pending > 0)
+    g_cond_wait (&barrier.cond, &barrier.lock);
+  g_mutex_unlock (&barrier.lock);
+
+  g_mutex_clear (&barrier.lock);
+  g_cond_clear (&barrier.cond);
+  g_free (scratch_mem);
+
+  return n_split;
+}
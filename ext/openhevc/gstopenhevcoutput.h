@@ -0,0 +1,94 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_OUTPUT_H__
+#define __GST_OPENHEVC_OUTPUT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* most bands a plane is split into when copying in parallel, more threads
+ * than this don't get any more memory bandwidth */
+#define GST_OPENHEVC_OUTPUT_MAX_BANDS 8
+
+typedef enum
+{
+  GST_OPENHEVC_COPY_PLANE,
+  /* src and src2 into a semi-planar chroma plane */
+  GST_OPENHEVC_COPY_INTERLEAVE,
+  /* the same while box filtering by scale */
+  GST_OPENHEVC_COPY_DOWNSCALE,
+  GST_OPENHEVC_COPY_DOWNSCALE_INTERLEAVE,
+  /* the first two while dropping shift bits */
+  GST_OPENHEVC_COPY_REDUCE,
+  GST_OPENHEVC_COPY_REDUCE_INTERLEAVE,
+} GstOpenHEVCCopyOp;
+
+typedef struct _GstOpenHEVCCopyBarrier GstOpenHEVCCopyBarrier;
+
+/**
+ * GstOpenHEVCCopyJob:
+ *
+ * Produces one plane of the output frame, or a band of its rows, from the
+ * planes of a decoded picture.
+ */
+typedef struct
+{
+  GstOpenHEVCCopyOp op;
+  guint8 *dst;
+  gsize dst_stride;
+  const guint8 *src;
+  gsize src_stride;
+  const guint8 *src2;
+  gsize src2_stride;
+  /* bytes of each source row */
+  gsize row_bytes;
+  /* bytes per source sample */
+  guint pstride;
+  /* destination rows, and the source rows they're made of */
+  guint rows;
+  guint src_rows;
+  guint scale;
+  /* bits to drop, and the picture row dst starts at for the dither */
+  guint shift;
+  gboolean dither;
+  guint row;
+  gboolean non_temporal;
+  /* set by gst_openhevc_output_run_jobs() */
+  guint8 *scratch;
+
+  GstOpenHEVCCopyBarrier *barrier;
+} GstOpenHEVCCopyJob;
+
+GstVideoFormat gst_openhevc_output_choose_format (GstVideoFormat native,
+    guint depth, GstCaps * allowed);
+
+guint gst_openhevc_output_build_jobs (GstOpenHEVCCopyJob * jobs,
+    GstVideoFrame * dst_frame, const GstVideoInfo * src_info,
+    const guint8 * const src[3], const gsize src_stride[3], guint scale,
+    gboolean dither);
+
+guint gst_openhevc_output_run_jobs (GstOpenHEVCCopyJob * jobs, guint n_jobs,
+    GstTaskPool * pool, guint n_bands);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_OUTPUT_H__ */
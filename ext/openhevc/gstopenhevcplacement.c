@@ -0,0 +1,450 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* sched_setaffinity() and the CPU_* macros */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include "gstopenhevcplacement.h"
+#include "gstopenhevc.h"
+
+/*
+ * OpenHEVC creates its worker threads itself without exposing them.  New
+ * threads start out with the CPU affinity of the thread creating them, so
+ * the decoder binds the streaming thread to the requested CPUs while it
+ * creates a handle and restores its previous affinity right after.
+ *
+ * Output memory is placed with an allocator that gives its mappings a
+ * preferred NUMA node policy.  The kernel then allocates their pages on
+ * that node when they're first written, wherever the writing thread runs.
+ */
+
+#define GST_OPENHEVC_NUMA_MEMORY_TYPE "OpenHEVCNuma"
+
+#define SYSFS_NODE_DIR "/sys/devices/system/node"
+
+/* Parses a list of CPU numbers and ranges like "0-3,8,10-11", the format of
+ * the sysfs cpulist files, into @cpus */
+static gboolean
+parse_cpu_list (const gchar * list, gboolean * cpus)
+{
+  const gchar *p = list;
+  gboolean any = FALSE;
+
+  memset (cpus, 0, GST_OPENHEVC_PLACEMENT_MAX_CPUS * sizeof (gboolean));
+
+  while (*p) {
+    guint64 first, last;
+    gchar *end;
+
+    while (g_ascii_isspace (*p))
+      p++;
+    if (*p == '\0')
+      break;
+
+    if (!g_ascii_isdigit (*p))
+      return FALSE;
+    first = last = g_ascii_strtoull (p, &end, 10);
+    p = end;
+    if (*p == '-') {
+      p++;
+      if (!g_ascii_isdigit (*p))
+        return FALSE;
+      last = g_ascii_strtoull (p, &end, 10);
+      p = end;
+    }
+
+    if (first > last || last >= GST_OPENHEVC_PLACEMENT_MAX_CPUS)
+      return FALSE;
+    for (; first <= last; first++)
+      cpus[first] = TRUE;
+    any = TRUE;
+
+    while (g_ascii_isspace (*p))
+      p++;
+    if (*p == ',')
+      p++;
+    else if (*p != '\0')
+      return FALSE;
+  }
+
+  return any;
+}
+
+static gchar *
+format_cpu_list (const gboolean * cpus)
+{
+  GString *s = g_string_new (NULL);
+  guint i = 0;
+
+  while (i < GST_OPENHEVC_PLACEMENT_MAX_CPUS) {
+    guint first;
+
+    if (!cpus[i]) {
+      i++;
+      continue;
+    }
+
+    first = i;
+    while (i + 1 < GST_OPENHEVC_PLACEMENT_MAX_CPUS && cpus[i + 1])
+      i++;
+
+    if (s->len > 0)
+      g_string_append_c (s, ',');
+    if (first == i)
+      g_string_append_printf (s, "%u", first);
+    else
+      g_string_append_printf (s, "%u-%u", first, i);
+    i++;
+  }
+
+  return g_string_free (s, FALSE);
+}
+
+/**
+ * gst_openhevc_placement_normalize_cpus:
+ * @cpu_list: list of CPU numbers and ranges like "0-3,8"
+ *
+ * Returns: (nullable): @cpu_list with merged, sorted ranges, or %NULL if it
+ * isn't a valid non-empty list
+ */
+gchar *
+gst_openhevc_placement_normalize_cpus (const gchar * cpu_list)
+{
+  gboolean *cpus;
+  gchar *normalized = NULL;
+
+  if (cpu_list == NULL)
+    return NULL;
+
+  cpus = g_new (gboolean, GST_OPENHEVC_PLACEMENT_MAX_CPUS);
+  if (parse_cpu_list (cpu_list, cpus))
+    normalized = format_cpu_list (cpus);
+  g_free (cpus);
+
+  return normalized;
+}
+
+/**
+ * gst_openhevc_placement_resolve_cpus:
+ * @cpu_list: (nullable): list of CPUs to run on
+ * @numa_node: NUMA node to run on if @cpu_list is %NULL, -1 for none
+ *
+ * Returns: (nullable): the normalized list of CPUs threads should be bound
+ * to, or %NULL to leave them unrestricted
+ */
+gchar *
+gst_openhevc_placement_resolve_cpus (const gchar * cpu_list, gint numa_node)
+{
+  gchar *path, *contents = NULL, *cpus;
+
+  if (cpu_list != NULL || numa_node < 0)
+    return gst_openhevc_placement_normalize_cpus (cpu_list);
+
+  path = g_strdup_printf (SYSFS_NODE_DIR "/node%d/cpulist", numa_node);
+  if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+    GST_WARNING ("no CPUs known for NUMA node %d", numa_node);
+    g_free (path);
+    return NULL;
+  }
+  g_free (path);
+
+  /* memory-only nodes have an empty list */
+  cpus = gst_openhevc_placement_normalize_cpus (contents);
+  g_free (contents);
+
+  return cpus;
+}
+
+/**
+ * gst_openhevc_placement_bind_thread:
+ * @cpus: (nullable): normalized list of CPUs
+ *
+ * Restricts the calling thread, and all threads it creates from now on, to
+ * @cpus.
+ *
+ * Returns: (nullable): the previous affinity of the calling thread for
+ * gst_openhevc_placement_restore_thread(), %NULL if it didn't change
+ */
+gpointer
+gst_openhevc_placement_bind_thread (const gchar * cpus)
+{
+#ifdef __linux__
+  gboolean *list;
+  cpu_set_t set, *saved;
+  guint i;
+
+  if (cpus == NULL)
+    return NULL;
+
+  list = g_new (gboolean, GST_OPENHEVC_PLACEMENT_MAX_CPUS);
+  if (!parse_cpu_list (cpus, list)) {
+    g_free (list);
+    return NULL;
+  }
+
+  CPU_ZERO (&set);
+  for (i = 0; i < GST_OPENHEVC_PLACEMENT_MAX_CPUS && i < CPU_SETSIZE; i++) {
+    if (list[i])
+      CPU_SET (i, &set);
+  }
+  g_free (list);
+
+  saved = g_new (cpu_set_t, 1);
+  if (sched_getaffinity (0, sizeof (cpu_set_t), saved) != 0)
+    goto failed;
+  if (sched_setaffinity (0, sizeof (cpu_set_t), &set) != 0)
+    goto failed;
+
+  return saved;
+
+failed:
+  {
+    GST_WARNING ("failed to bind thread to CPUs %s: %s", cpus,
+        g_strerror (errno));
+    g_free (saved);
+    return NULL;
+  }
+#else
+  if (cpus != NULL)
+    GST_WARNING ("CPU affinity is not supported on this platform");
+
+  return NULL;
+#endif
+}
+
+/**
+ * gst_openhevc_placement_restore_thread:
+ * @saved: (nullable) (transfer full): return value of
+ *     gst_openhevc_placement_bind_thread()
+ *
+ * Restores the affinity the calling thread had before binding it.
+ */
+void
+gst_openhevc_placement_restore_thread (gpointer saved)
+{
+#ifdef __linux__
+  if (saved == NULL)
+    return;
+
+  if (sched_setaffinity (0, sizeof (cpu_set_t), saved) != 0)
+    GST_WARNING ("failed to restore thread affinity: %s", g_strerror (errno));
+  g_free (saved);
+#endif
+}
+
+#ifdef __linux__
+
+typedef struct
+{
+  GstAllocator parent;
+
+  gint node;
+  gsize page_size;
+  gboolean warned;
+} GstOpenHEVCNumaAllocator;
+
+typedef struct
+{
+  GstAllocatorClass parent_class;
+} GstOpenHEVCNumaAllocatorClass;
+
+typedef struct
+{
+  GstMemory mem;
+
+  /* the mapping, only set on the root memory */
+  guint8 *data;
+  gsize mapped_size;
+} GstOpenHEVCNumaMemory;
+
+GType gst_openhevc_numa_allocator_get_type (void);
+G_DEFINE_TYPE (GstOpenHEVCNumaAllocator, gst_openhevc_numa_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static gpointer
+_numa_mem_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
+{
+  while (mem->parent)
+    mem = mem->parent;
+
+  return ((GstOpenHEVCNumaMemory *) mem)->data;
+}
+
+static void
+_numa_mem_unmap (GstMemory * mem)
+{
+}
+
+static GstMemory *
+_numa_mem_share (GstMemory * mem, gssize offset, gssize size)
+{
+  GstOpenHEVCNumaMemory *sub;
+  GstMemory *parent;
+
+  if (size == -1)
+    size = mem->size - offset;
+
+  if ((parent = mem->parent) == NULL)
+    parent = mem;
+
+  sub = g_slice_new0 (GstOpenHEVCNumaMemory);
+  gst_memory_init (GST_MEMORY_CAST (sub),
+      GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+      mem->allocator, parent, mem->maxsize, mem->align, mem->offset + offset,
+      size);
+
+  return GST_MEMORY_CAST (sub);
+}
+
+static GstMemory *
+gst_openhevc_numa_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  GstOpenHEVCNumaAllocator *alloc = (GstOpenHEVCNumaAllocator *) allocator;
+  GstOpenHEVCNumaMemory *nmem;
+  gulong nodemask[GST_OPENHEVC_PLACEMENT_MAX_CPUS / (8 * sizeof (gulong))];
+  gsize maxsize, mapped_size, align;
+  guint8 *data;
+
+  align = params->align | gst_memory_alignment;
+  /* mappings are page aligned */
+  if (align >= alloc->page_size)
+    return NULL;
+
+  maxsize = size + params->prefix + params->padding;
+  mapped_size = (maxsize + alloc->page_size - 1) & ~(alloc->page_size - 1);
+
+  data = mmap (NULL, mapped_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED)
+    return NULL;
+
+  /* preferred rather than bound, a full node must not fail the allocation */
+  memset (nodemask, 0, sizeof (nodemask));
+  nodemask[alloc->node / (8 * sizeof (gulong))] =
+      1UL << (alloc->node % (8 * sizeof (gulong)));
+  if (syscall (SYS_mbind, data, mapped_size, MPOL_PREFERRED, nodemask,
+          (gulong) (8 * sizeof (nodemask)) + 1, 0) != 0 && !alloc->warned) {
+    GST_WARNING_OBJECT (alloc, "failed to place memory on NUMA node %d: %s",
+        alloc->node, g_strerror (errno));
+    alloc->warned = TRUE;
+  }
+
+  /* anonymous mappings are zero filled, which takes care of the
+   * ZERO_PREFIXED and ZERO_PADDED flags */
+  nmem = g_slice_new0 (GstOpenHEVCNumaMemory);
+  gst_memory_init (GST_MEMORY_CAST (nmem), params->flags, allocator, NULL,
+      maxsize, align, params->prefix, size);
+  nmem->data = data;
+  nmem->mapped_size = mapped_size;
+
+  return GST_MEMORY_CAST (nmem);
+}
+
+static void
+gst_openhevc_numa_allocator_free (GstAllocator * allocator, GstMemory * mem)
+{
+  GstOpenHEVCNumaMemory *nmem = (GstOpenHEVCNumaMemory *) mem;
+
+  if (mem->parent == NULL)
+    munmap (nmem->data, nmem->mapped_size);
+
+  g_slice_free (GstOpenHEVCNumaMemory, nmem);
+}
+
+static void
+gst_openhevc_numa_allocator_class_init (GstOpenHEVCNumaAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  allocator_class->alloc = gst_openhevc_numa_allocator_alloc;
+  allocator_class->free = gst_openhevc_numa_allocator_free;
+}
+
+static void
+gst_openhevc_numa_allocator_init (GstOpenHEVCNumaAllocator * alloc)
+{
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (alloc);
+
+  /* copies fall back to allocating from us as well */
+  allocator->mem_type = GST_OPENHEVC_NUMA_MEMORY_TYPE;
+  allocator->mem_map = _numa_mem_map;
+  allocator->mem_unmap = _numa_mem_unmap;
+  allocator->mem_share = _numa_mem_share;
+
+  alloc->page_size = sysconf (_SC_PAGESIZE);
+}
+
+#endif
+
+/**
+ * gst_openhevc_numa_allocator_new:
+ * @node: NUMA node to place memory on
+ *
+ * Returns: (transfer full) (nullable): an allocator for system memory
+ * preferably placed on @node, or %NULL if there is no such node or NUMA
+ * placement isn't supported
+ */
+GstAllocator *
+gst_openhevc_numa_allocator_new (gint node)
+{
+#ifdef __linux__
+  GstOpenHEVCNumaAllocator *alloc;
+  gchar *path;
+  gboolean exists;
+
+  if (node < 0 || node >= GST_OPENHEVC_PLACEMENT_MAX_CPUS)
+    return NULL;
+
+  path = g_strdup_printf (SYSFS_NODE_DIR "/node%d", node);
+  exists = g_file_test (path, G_FILE_TEST_IS_DIR);
+  g_free (path);
+  if (!exists) {
+    GST_WARNING ("NUMA node %d does not exist", node);
+    return NULL;
+  }
+
+  alloc = g_object_new (gst_openhevc_numa_allocator_get_type (), NULL);
+  alloc->node = node;
+  gst_object_ref_sink (alloc);
+
+  return GST_ALLOCATOR_CAST (alloc);
+#else
+  GST_WARNING ("NUMA placement is not supported on this platform");
+
+  return NULL;
+#endif
+}
@@ -0,0 +1,43 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_PLACEMENT_H__
+#define __GST_OPENHEVC_PLACEMENT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* highest CPU number a cpu list may contain, plus one */
+#define GST_OPENHEVC_PLACEMENT_MAX_CPUS 1024
+
+gchar * gst_openhevc_placement_normalize_cpus (const gchar * cpu_list);
+
+gchar * gst_openhevc_placement_resolve_cpus (const gchar * cpu_list,
+    gint numa_node);
+
+gpointer gst_openhevc_placement_bind_thread (const gchar * cpus);
+
+void gst_openhevc_placement_restore_thread (gpointer saved);
+
+GstAllocator * gst_openhevc_numa_allocator_new (gint node);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_PLACEMENT_H__ */
@@ -0,0 +1,189 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstopenhevcsharedpool.h"
+#include "gstopenhevc.h"
+
+/*
+ * OpenHEVC runs its work on threads owned by each handle and has no way to
+ * hand it to an external pool.  Decoders in shared-pool mode instead split
+ * one process wide budget of a thread per core: each of them creates only
+ * its share of the threads, and a decode call only starts once what it is
+ * charged fits into what the other members' running calls leave of the
+ * budget.
+ *
+ * A member's share is fixed when it joins, as an equal split of the budget
+ * among the members expected by then.  Shares are not rebalanced, as the
+ * threads already run, so the shares can add up to more than the budget
+ * when more decoders join than expected.  A call is charged the threads of
+ * its decoder but at most an equal split among the current members, which
+ * keeps any member from locking out the others.
+ *
+ * Waiting calls are served by priority and then in arrival order, and as
+ * every decoder has at most one call in flight that's round robin between
+ * decoders of the same priority.  A waiting call is passed by at most
+ * MAX_BYPASS calls of higher priority so that busy decoders of a higher
+ * priority don't starve the others.
+ */
+
+#define MAX_BYPASS 4
+
+typedef struct
+{
+  gint priority;
+  /* times calls of higher priority were queued ahead */
+  guint bypassed;
+} Waiter;
+
+static GMutex shared_lock;
+static GCond shared_cond;
+static guint members;
+static guint budget;
+static guint in_use;
+/* waiting calls, the next one to run first */
+static GQueue waiters = G_QUEUE_INIT;
+
+/* with shared_lock */
+static void
+gst_openhevc_shared_pool_init_budget (void)
+{
+  if (budget == 0)
+    budget = MAX (g_get_num_processors (), 1);
+}
+
+/**
+ * gst_openhevc_shared_pool_join:
+ * @expected: number of members expected to share the budget, 0 for the
+ *     current ones including the new one
+ *
+ * Adds a decoder to the ones splitting the thread budget.
+ *
+ * Returns: the number of decoder threads the new member should create
+ */
+guint
+gst_openhevc_shared_pool_join (guint expected)
+{
+  guint share;
+
+  g_mutex_lock (&shared_lock);
+  gst_openhevc_shared_pool_init_budget ();
+  members++;
+  share = MAX (budget / MAX (members, expected), 1);
+  GST_DEBUG ("%u decoders share %u threads, new share %u", members, budget,
+      share);
+  g_mutex_unlock (&shared_lock);
+
+  return share;
+}
+
+/**
+ * gst_openhevc_shared_pool_leave:
+ *
+ * Removes a decoder added with gst_openhevc_shared_pool_join().
+ */
+void
+gst_openhevc_shared_pool_leave (void)
+{
+  g_mutex_lock (&shared_lock);
+  g_warn_if_fail (members > 0);
+  members--;
+  g_mutex_unlock (&shared_lock);
+}
+
+/* with shared_lock.  Queues @self behind all waiters of at least its
+ * priority and those that were bypassed often enough already */
+static void
+gst_openhevc_shared_pool_queue (Waiter * self)
+{
+  GList *l, *behind = NULL;
+
+  for (l = waiters.head; l; l = l->next) {
+    Waiter *queued = l->data;
+
+    if (queued->priority >= self->priority || queued->bypassed >= MAX_BYPASS)
+      behind = l;
+  }
+
+  if (behind)
+    g_queue_insert_after (&waiters, behind, self);
+  else
+    g_queue_push_head (&waiters, self);
+
+  for (l = behind ? behind->next->next : waiters.head->next; l; l = l->next)
+    ((Waiter *) l->data)->bypassed++;
+}
+
+/**
+ * gst_openhevc_shared_pool_enter:
+ * @threads: number of threads the call can keep busy
+ * @priority: calls with a higher priority run first
+ *
+ * Blocks until it's the caller's turn and the threads it is charged are
+ * available.
+ *
+ * Returns: the number of threads charged, to be passed to
+ * gst_openhevc_shared_pool_exit() after the call
+ */
+guint
+gst_openhevc_shared_pool_enter (guint threads, gint priority)
+{
+  Waiter self;
+  guint charged;
+
+  g_mutex_lock (&shared_lock);
+  gst_openhevc_shared_pool_init_budget ();
+  self.priority = priority;
+  self.bypassed = 0;
+
+  gst_openhevc_shared_pool_queue (&self);
+  for (;;) {
+    charged = CLAMP (threads, 1, MAX (budget / MAX (members, 1), 1));
+    if (g_queue_peek_head (&waiters) == &self && in_use + charged <= budget)
+      break;
+    g_cond_wait (&shared_cond, &shared_lock);
+  }
+
+  g_queue_pop_head (&waiters);
+  in_use += charged;
+  /* the next in line might fit as well */
+  g_cond_broadcast (&shared_cond);
+  g_mutex_unlock (&shared_lock);
+
+  return charged;
+}
+
+/**
+ * gst_openhevc_shared_pool_exit:
+ * @charged: the value returned by gst_openhevc_shared_pool_enter()
+ *
+ * Gives the threads of a finished call back to the budget.
+ */
+void
+gst_openhevc_shared_pool_exit (guint charged)
+{
+  g_mutex_lock (&shared_lock);
+  g_warn_if_fail (in_use >= charged);
+  in_use -= MIN (charged, in_use);
+  g_cond_broadcast (&shared_cond);
+  g_mutex_unlock (&shared_lock);
+}
@@ -0,0 +1,213 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstopenhevcsps.h"
+
+/* MaxDpbSize of all levels */
+#define MAX_DPB_SIZE 16
+
+/* MSB first bit reader over NAL unit payload, skipping emulation
+ * prevention bytes */
+typedef struct
+{
+  const guint8 *data;
+  gsize size;
+  gsize pos;
+  guint bit;
+  guint zeros;
+  gboolean overrun;
+} BitReader;
+
+static guint
+read_bit (BitReader * br)
+{
+  guint val;
+
+  if (br->bit == 0) {
+    /* 0x000003 -> 0x0000 */
+    if (br->zeros >= 2 && br->pos < br->size && br->data[br->pos] == 0x03) {
+      br->pos++;
+      br->zeros = 0;
+    }
+    if (br->pos >= br->size) {
+      br->overrun = TRUE;
+      return 0;
+    }
+    br->zeros = br->data[br->pos] == 0 ? br->zeros + 1 : 0;
+  }
+
+  val = (br->data[br->pos] >> (7 - br->bit)) & 1;
+  if (++br->bit == 8) {
+    br->bit = 0;
+    br->pos++;
+  }
+
+  return val;
+}
+
+static guint32
+read_bits (BitReader * br, guint n)
+{
+  guint32 val = 0;
+
+  while (n--)
+    val = (val << 1) | read_bit (br);
+
+  return val;
+}
+
+static void
+skip_bits (BitReader * br, guint n)
+{
+  while (n--)
+    read_bit (br);
+}
+
+static guint32
+read_ue (BitReader * br)
+{
+  guint leading = 0;
+
+  while (read_bit (br) == 0 && !br->overrun) {
+    if (++leading > 31) {
+      br->overrun = TRUE;
+      return 0;
+    }
+  }
+
+  return ((1u << leading) - 1) + read_bits (br, leading);
+}
+
+static void
+skip_profile_tier_level (BitReader * br, guint max_sub_layers_minus1)
+{
+  gboolean profile_present[8], level_present[8];
+  guint i;
+
+  /* general profile space, tier, idc, compatibility and constraint flags,
+   * then general_level_idc */
+  skip_bits (br, 88 + 8);
+
+  for (i = 0; i < max_sub_layers_minus1; i++) {
+    profile_present[i] = read_bit (br);
+    level_present[i] = read_bit (br);
+  }
+  if (max_sub_layers_minus1 > 0)
+    skip_bits (br, 2 * (8 - max_sub_layers_minus1));
+
+  for (i = 0; i < max_sub_layers_minus1; i++) {
+    if (profile_present[i])
+      skip_bits (br, 88);
+    if (level_present[i])
+      skip_bits (br, 8);
+  }
+}
+
+/**
+ * gst_openhevc_sps_parse:
+ * @sps: (out): the parsed fields
+ * @data: SPS NAL unit, starting with its NAL unit header
+ * @size: size of @data, may extend past the NAL unit
+ *
+ * Returns: %TRUE if everything up to the sub-layer ordering info could be
+ * parsed and is within the ranges the spec allows
+ */
+gboolean
+gst_openhevc_sps_parse (GstOpenHEVCSPS * sps, const guint8 * data,
+    gsize size)
+{
+  BitReader br = { data, size, 0, 0, 0, FALSE };
+  guint max_sub_layers_minus1, sub_width, sub_height, i;
+  guint max_latency_increase_plus1 = 0;
+  gboolean ordering_info_present;
+
+  memset (sps, 0, sizeof (*sps));
+
+  /* NAL unit header */
+  skip_bits (&br, 16);
+
+  skip_bits (&br, 4);           /* sps_video_parameter_set_id */
+  max_sub_layers_minus1 = read_bits (&br, 3);
+  if (max_sub_layers_minus1 > 6)
+    return FALSE;
+  sps->max_sub_layers = max_sub_layers_minus1 + 1;
+  skip_bits (&br, 1);           /* sps_temporal_id_nesting_flag */
+
+  skip_profile_tier_level (&br, max_sub_layers_minus1);
+
+  read_ue (&br);                /* sps_seq_parameter_set_id */
+  sps->chroma_format_idc = read_ue (&br);
+  if (sps->chroma_format_idc > 3)
+    return FALSE;
+  if (sps->chroma_format_idc == 3 && read_bit (&br))
+    /* separate_colour_plane_flag, coded like monochrome */
+    sps->chroma_format_idc = 0;
+
+  sps->width = read_ue (&br);
+  sps->height = read_ue (&br);
+
+  /* OpenHEVC applies the conformance window to the pictures it outputs,
+   * so it's only checked */
+  if (read_bit (&br)) {
+    guint64 crop_width, crop_height;
+
+    /* offsets are in chroma samples */
+    sub_width = sps->chroma_format_idc == 1 || sps->chroma_format_idc == 2
+        ? 2 : 1;
+    sub_height = sps->chroma_format_idc == 1 ? 2 : 1;
+    crop_width = (guint64) read_ue (&br) + read_ue (&br);
+    crop_height = (guint64) read_ue (&br) + read_ue (&br);
+    if (crop_width * sub_width >= sps->width
+        || crop_height * sub_height >= sps->height)
+      return FALSE;
+  }
+
+  sps->bit_depth_luma = read_ue (&br) + 8;
+  sps->bit_depth_chroma = read_ue (&br) + 8;
+  read_ue (&br);                /* log2_max_pic_order_cnt_lsb_minus4 */
+
+  /* without ordering info, the values apply to all sub-layers.  Keep those
+   * of the highest one */
+  ordering_info_present = read_bit (&br);
+  for (i = ordering_info_present ? 0 : max_sub_layers_minus1;
+      i <= max_sub_layers_minus1; i++) {
+    sps->max_dec_pic_buffering = read_ue (&br) + 1;
+    sps->max_num_reorder_pics = read_ue (&br);
+    max_latency_increase_plus1 = read_ue (&br);
+    if (sps->max_dec_pic_buffering > MAX_DPB_SIZE
+        || sps->max_num_reorder_pics >= sps->max_dec_pic_buffering)
+      return FALSE;
+  }
+
+  /* the DPB being full outputs a picture anyway, so larger limits don't
+   * make a difference */
+  if (max_latency_increase_plus1)
+    sps->max_latency_pictures = sps->max_num_reorder_pics +
+        MIN (max_latency_increase_plus1 - 1, MAX_DPB_SIZE);
+  sps->max_latency_pictures = MIN (sps->max_latency_pictures,
+      sps->max_dec_pic_buffering - 1);
+
+  return !br.overrun && sps->width > 0 && sps->height > 0;
+}
@@ -0,0 +1,55 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_SPS_H__
+#define __GST_OPENHEVC_SPS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstOpenHEVCSPS GstOpenHEVCSPS;
+
+/**
+ * GstOpenHEVCSPS:
+ *
+ * The fields of a sequence parameter set the element needs to know before
+ * OpenHEVC outputs a picture.  The DPB fields are those of the highest
+ * temporal sub-layer.
+ */
+struct _GstOpenHEVCSPS
+{
+  guint max_sub_layers;
+  guint chroma_format_idc;
+  guint width;
+  guint height;
+  guint bit_depth_luma;
+  guint bit_depth_chroma;
+  guint max_dec_pic_buffering;
+  guint max_num_reorder_pics;
+  /* 0 if there is no limit */
+  guint max_latency_pictures;
+};
+
+gboolean gst_openhevc_sps_parse (GstOpenHEVCSPS * sps, const guint8 * data,
+    gsize size);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_SPS_H__ */
@@ -0,0 +1,360 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * SECTION:tracer-openhevcstats
+ *
+ * Collects per openhevcdec instance latency histograms for the stages a
+ * frame goes through: decode, reorder, copy and push.  The p50, p99 and
+ * maximum of each stage are logged when the decoder goes away or tracing
+ * ends.
+ *
+ * |[
+ * GST_TRACERS="openhevcstats" GST_DEBUG="GST_TRACER:7" gst-launch-1.0 ...
+ * ]|
+ *
+ * The decoder only takes timestamps while this tracer exists.
+ */
+
+#include <string.h>
+
+#include "gstopenhevcstats.h"
+#include "gstopenhevc.h"
+
+/* 8 linear sub-buckets per power of two, i.e. at most 12.5% error, for
+ * durations of up to 2^40ns */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_BITS 40
+#define N_BUCKETS ((MAX_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS)
+
+typedef struct _GstOpenHEVCStatsTracer GstOpenHEVCStatsTracer;
+typedef struct _GstOpenHEVCStatsTracerClass GstOpenHEVCStatsTracerClass;
+
+struct _GstOpenHEVCStatsTracer
+{
+  GstTracer parent;
+
+  GMutex lock;
+  GList *instances;
+};
+
+struct _GstOpenHEVCStatsTracerClass
+{
+  GstTracerClass parent_class;
+};
+
+/* written from the decoder's streaming thread, read whenever reporting */
+struct _GstOpenHEVCStats
+{
+  gint ref_count;
+  gchar *name;
+  /* atomic */
+  gint counts[GST_OPENHEVC_STAGE_LAST][N_BUCKETS];
+  /* in ns, with max_lock as there are no portable 64 bit atomics.  Only
+   * the decoder takes it per frame, so it's uncontended */
+  GMutex max_lock;
+  guint64 max[GST_OPENHEVC_STAGE_LAST];
+};
+
+static const gchar *stage_names[] = { "decode", "reorder", "copy", "push" };
+
+G_STATIC_ASSERT (G_N_ELEMENTS (stage_names) == GST_OPENHEVC_STAGE_LAST);
+
+/* set and cleared with tracer_lock, also read without it as a hint */
+GstTracer *gst_openhevc_stats_tracer;
+static GMutex tracer_lock;
+static GstTracerRecord *tr_latency;
+
+G_DEFINE_TYPE (GstOpenHEVCStatsTracer, gst_openhevc_stats_tracer,
+    GST_TYPE_TRACER);
+
+static guint
+bucket_index (guint64 ns)
+{
+  guint msb = 0;
+  guint64 v;
+
+  ns = MIN (ns, (G_GUINT64_CONSTANT (1) << MAX_BITS) - 1);
+  if (ns < SUB_BUCKETS)
+    return ns;
+
+  for (v = ns; v >>= 1;)
+    msb++;
+
+  return ((msb - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS)
+      + ((ns >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* largest value that falls into bucket @i */
+static guint64
+bucket_upper (guint i)
+{
+  guint shift;
+
+  if (i < SUB_BUCKETS)
+    return i;
+
+  shift = (i >> SUB_BUCKET_BITS) - 1;
+  return (((guint64) (SUB_BUCKETS + (i & (SUB_BUCKETS - 1))) + 1) << shift)
+      - 1;
+}
+
+static GstOpenHEVCStats *
+stats_new (GstElement * element)
+{
+  GstOpenHEVCStats *stats = g_new0 (GstOpenHEVCStats, 1);
+
+  stats->ref_count = 1;
+  stats->name = gst_object_get_name (GST_OBJECT (element));
+  g_mutex_init (&stats->max_lock);
+
+  return stats;
+}
+
+static GstOpenHEVCStats *
+stats_ref (GstOpenHEVCStats * stats)
+{
+  g_atomic_int_inc (&stats->ref_count);
+
+  return stats;
+}
+
+static void
+stats_unref (GstOpenHEVCStats * stats)
+{
+  if (g_atomic_int_dec_and_test (&stats->ref_count)) {
+    g_mutex_clear (&stats->max_lock);
+    g_free (stats->name);
+    g_free (stats);
+  }
+}
+
+/* the running tracer with a ref, or NULL.  The tracer can go away
+ * concurrently with the decoders that report to it */
+static GstOpenHEVCStatsTracer *
+stats_tracer_get (void)
+{
+  GstTracer *tracer;
+
+  g_mutex_lock (&tracer_lock);
+  if ((tracer = gst_openhevc_stats_tracer))
+    gst_object_ref (tracer);
+  g_mutex_unlock (&tracer_lock);
+
+  return (GstOpenHEVCStatsTracer *) tracer;
+}
+
+static guint64
+stats_percentile (GstOpenHEVCStats * stats, GstOpenHEVCStage stage,
+    guint64 total, guint percent)
+{
+  guint64 target = (total * percent + 99) / 100, seen = 0;
+  guint i;
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    seen += g_atomic_int_get (&stats->counts[stage][i]);
+    if (seen >= target)
+      return bucket_upper (i);
+  }
+
+  return bucket_upper (N_BUCKETS - 1);
+}
+
+static void
+stats_log (GstOpenHEVCStats * stats)
+{
+  GstOpenHEVCStage stage;
+
+  for (stage = 0; stage < GST_OPENHEVC_STAGE_LAST; stage++) {
+    guint64 total = 0, max;
+    guint i;
+
+    for (i = 0; i < N_BUCKETS; i++)
+      total += g_atomic_int_get (&stats->counts[stage][i]);
+    if (total == 0)
+      continue;
+
+    g_mutex_lock (&stats->max_lock);
+    max = stats->max[stage];
+    g_mutex_unlock (&stats->max_lock);
+    /* the percentiles are the upper bounds of their buckets */
+    gst_tracer_record_log (tr_latency, stats->name, stage_names[stage], total,
+        stats_percentile (stats, stage, total, 50),
+        stats_percentile (stats, stage, total, 99), max);
+  }
+}
+
+/**
+ * gst_openhevc_stats_record:
+ * @element: the decoder
+ * @stats: (inout): the decoder's stats, allocated on first use
+ * @stage: the stage that ended
+ * @start: when @stage started
+ *
+ * Adds the time since @start to the histogram of @stage.  Use
+ * GST_OPENHEVC_STATS_RECORD() which only calls this while tracing.
+ */
+void
+gst_openhevc_stats_record (GstElement * element, GstOpenHEVCStats ** stats,
+    GstOpenHEVCStage stage, GstClockTime start)
+{
+  GstClockTime elapsed = gst_util_get_timestamp () - start;
+  GstOpenHEVCStatsTracer *self;
+  GstOpenHEVCStats *s;
+
+  s = g_atomic_pointer_get (stats);
+  if (G_UNLIKELY (s == NULL)) {
+    /* registering needs the tracer, later records only touch @stats */
+    if ((self = stats_tracer_get ()) == NULL)
+      return;
+
+    s = stats_new (element);
+    if (!g_atomic_pointer_compare_and_exchange (stats, NULL, s)) {
+      stats_unref (s);
+      s = g_atomic_pointer_get (stats);
+    } else {
+      g_mutex_lock (&self->lock);
+      self->instances = g_list_prepend (self->instances, stats_ref (s));
+      g_mutex_unlock (&self->lock);
+    }
+    gst_object_unref (self);
+  }
+
+  g_atomic_int_inc (&s->counts[stage][bucket_index (elapsed)]);
+
+  g_mutex_lock (&s->max_lock);
+  s->max[stage] = MAX (s->max[stage], elapsed);
+  g_mutex_unlock (&s->max_lock);
+}
+
+/**
+ * gst_openhevc_stats_release:
+ * @stats: (inout): the decoder's stats
+ *
+ * Logs the final histograms of a decoder that's going away.
+ */
+void
+gst_openhevc_stats_release (GstOpenHEVCStats ** stats)
+{
+  GstOpenHEVCStatsTracer *self;
+  GstOpenHEVCStats *s = *stats;
+  GList *l;
+
+  if (s == NULL)
+    return;
+  *stats = NULL;
+
+  if ((self = stats_tracer_get ())) {
+    g_mutex_lock (&self->lock);
+    if ((l = g_list_find (self->instances, s))) {
+      self->instances = g_list_delete_link (self->instances, l);
+      stats_log (s);
+      stats_unref (s);
+    }
+    g_mutex_unlock (&self->lock);
+    gst_object_unref (self);
+  }
+
+  stats_unref (s);
+}
+
+/* clearing the global before the last ref is gone lets a decoder that
+ * took a ref meanwhile keep the tracer alive until it's done */
+static void
+gst_openhevc_stats_tracer_dispose (GObject * object)
+{
+  g_mutex_lock (&tracer_lock);
+  if (gst_openhevc_stats_tracer == (GstTracer *) object)
+    g_atomic_pointer_set (&gst_openhevc_stats_tracer, NULL);
+  g_mutex_unlock (&tracer_lock);
+
+  G_OBJECT_CLASS (gst_openhevc_stats_tracer_parent_class)->dispose (object);
+}
+
+static void
+gst_openhevc_stats_tracer_finalize (GObject * object)
+{
+  GstOpenHEVCStatsTracer *self = (GstOpenHEVCStatsTracer *) object;
+
+  g_list_foreach (self->instances, (GFunc) stats_log, NULL);
+  g_list_free_full (self->instances, (GDestroyNotify) stats_unref);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_openhevc_stats_tracer_parent_class)->finalize (object);
+}
+
+static void
+gst_openhevc_stats_tracer_class_init (GstOpenHEVCStatsTracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->dispose = gst_openhevc_stats_tracer_dispose;
+  gobject_class->finalize = gst_openhevc_stats_tracer_finalize;
+
+  tr_latency = gst_tracer_record_new ("openhevc-latency.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "stage", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "description", G_TYPE_STRING, "decode, reorder, copy or push",
+          NULL),
+      "count", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "number of frames",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p50", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING,
+          "median time in ns, rounded up by up to 12.5%",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p99", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING,
+          "99th percentile time in ns, rounded up by up to 12.5%",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "max", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "maximum time in ns",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL), NULL);
+  GST_OBJECT_FLAG_SET (tr_latency, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_openhevc_stats_tracer_init (GstOpenHEVCStatsTracer * self)
+{
+  g_mutex_init (&self->lock);
+
+  g_mutex_lock (&tracer_lock);
+  if (gst_openhevc_stats_tracer != NULL)
+    GST_WARNING_OBJECT (self, "only one openhevcstats tracer is supported");
+  else
+    g_atomic_pointer_set (&gst_openhevc_stats_tracer, GST_TRACER (self));
+  g_mutex_unlock (&tracer_lock);
+}
@@ -0,0 +1,72 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_OPENHEVC_STATS_H__
+#define __GST_OPENHEVC_STATS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_OPENHEVC_STATS_TRACER (gst_openhevc_stats_tracer_get_type ())
+GType gst_openhevc_stats_tracer_get_type (void);
+
+typedef enum
+{
+  /* inside oh_decode() */
+  GST_OPENHEVC_STAGE_DECODE,
+  /* from oh_decode() returning to the picture being output, i.e. waiting
+   * for frame threads and in the reorder buffer */
+  GST_OPENHEVC_STAGE_REORDER,
+  /* copying the output picture into the output buffer */
+  GST_OPENHEVC_STAGE_COPY,
+  /* inside gst_video_decoder_finish_frame() */
+  GST_OPENHEVC_STAGE_PUSH,
+  GST_OPENHEVC_STAGE_LAST
+} GstOpenHEVCStage;
+
+typedef struct _GstOpenHEVCStats GstOpenHEVCStats;
+
+/* the running openhevcstats tracer, NULL when not tracing.  Only a hint,
+ * gst_openhevc_stats_record() checks again under a lock */
+extern GstTracer *gst_openhevc_stats_tracer;
+
+#define GST_OPENHEVC_STATS_ENABLED() \
+    G_UNLIKELY (g_atomic_pointer_get (&gst_openhevc_stats_tracer) != NULL)
+
+/* timestamp for the start of a stage if tracing, GST_CLOCK_TIME_NONE
+ * otherwise */
+#define GST_OPENHEVC_STATS_NOW() \
+    (GST_OPENHEVC_STATS_ENABLED () ? gst_util_get_timestamp () : \
+        GST_CLOCK_TIME_NONE)
+
+#define GST_OPENHEVC_STATS_RECORD(element, stats, stage, start) G_STMT_START { \
+  if (GST_OPENHEVC_STATS_ENABLED () && GST_CLOCK_TIME_IS_VALID (start)) \
+    gst_openhevc_stats_record ((GstElement *) (element), (stats), (stage), \
+        (start)); \
+} G_STMT_END
+
+void gst_openhevc_stats_record (GstElement * element,
+    GstOpenHEVCStats ** stats, GstOpenHEVCStage stage, GstClockTime start);
+
+void gst_openhevc_stats_release (GstOpenHEVCStats ** stats);
+
+G_END_DECLS
+
+#endif /* __GST_OPENHEVC_STATS_H__ */
@@ -25,29 +25,168 @@
 #include <string.h>
 
 #include "gstopenhevcviddec.h"
+#include "gstopenhevchandlepool.h"
+#include "gstopenhevcnal.h"
+#include "gstopenhevcoutput.h"
+#include "gstopenhevcplacement.h"
+#include "gstopenhevcsharedpool.h"
 #include "gstopenhevc.h"
 
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_PERFORMANCE);
 
-#define MAX_TS_MASK 0xff
+/* zeroed bytes OpenHEVC's bitstream reader may read past the end of the
+ * input, AV_INPUT_BUFFER_PADDING_SIZE of the libavcodec it is based on */
+#define INPUT_PADDING_SIZE              64
+#define INPUT_ARENA_ALIGN               64
 
+/* HEVC never keeps more pictures than this in the DPB */
+#define MAX_DPB_SIZE                    16
+
+/* output pool size when downstream doesn't limit it, unless the DPB and
+ * frame threads need more */
 #define REQUIRED_POOL_MAX_BUFFERS       32
 #define DEFAULT_STRIDE_ALIGN            31
 #define DEFAULT_ALLOC_PARAM             { 0, DEFAULT_STRIDE_ALIGN, 0, 0, }
 
 #define DEFAULT_MAX_THREADS             0
+#define DEFAULT_THREAD_TYPE             GST_OPENHEVC_THREAD_AUTO
+#define DEFAULT_LOW_LATENCY             FALSE
+#define DEFAULT_REUSE_HANDLES           FALSE
+#define DEFAULT_SHARED_POOL             FALSE
+#define DEFAULT_SHARED_POOL_SIZE        0
+#define DEFAULT_PRIORITY                0
+#define DEFAULT_CPU_AFFINITY            NULL
+#define DEFAULT_NUMA_NODE               -1
 #define DEFAULT_TEMPORAL_LAYER_ID       0
 #define DEFAULT_QUALITY_LAYER_ID        0
+#define DEFAULT_PARALLEL_COPY_THRESHOLD (8 * 1024 * 1024)
+#define DEFAULT_MAX_MEMORY              0
+#define DEFAULT_OUTPUT_SCALE            GST_OPENHEVC_OUTPUT_SCALE_NONE
+#define DEFAULT_OUTPUT_DEPTH            GST_OPENHEVC_OUTPUT_DEPTH_NATIVE
+#define DEFAULT_DITHER                  FALSE
+#define DEFAULT_KEYFRAMES_ONLY          FALSE
+#define DEFAULT_STATS_INTERVAL          0
+
+/* when later than this many frame durations, only IRAP pictures are decoded
+ * until we've caught up again */
+#define QOS_IRAP_ONLY_FRAMES            4
+#define QOS_DEFAULT_FRAME_DURATION      (40 * GST_MSECOND)
+
+#define NAL_TYPE_TSA_N                  2
+#define NAL_TYPE_STSA_R                 5
+#define NAL_TYPE_RASL_N                 8
+#define NAL_TYPE_RASL_R                 9
+#define NAL_TYPE_RSV_VCL_N14            14
+#define NAL_TYPE_BLA_W_LP               16
+#define NAL_TYPE_CRA                    21
+#define NAL_TYPE_RSV_IRAP_23            23
+#define NAL_TYPE_RSV_VCL31              31
+#define NAL_TYPE_VPS                    32
+#define NAL_TYPE_SPS                    33
+#define NAL_TYPE_PPS                    34
+
+/* the per sub-layer picture counts are halved once they reach this so that
+ * they follow changes in the GOP structure */
+#define SUB_LAYER_STATS_WINDOW          256
+#define SUB_LAYER_STATS_MIN             16
 
 enum
 {
   PROP_0,
   PROP_MAX_THREADS,
+  PROP_THREAD_TYPE,
+  PROP_LOW_LATENCY,
+  PROP_REUSE_HANDLES,
+  PROP_SHARED_POOL,
+  PROP_SHARED_POOL_SIZE,
+  PROP_PRIORITY,
+  PROP_CPU_AFFINITY,
+  PROP_NUMA_NODE,
   PROP_TEMPORAL_LAYER_ID,
   PROP_QUALITY_LAYER_ID,
+  PROP_PARALLEL_COPY_THRESHOLD,
+  PROP_MAX_MEMORY,
+  PROP_OUTPUT_SCALE,
+  PROP_OUTPUT_DEPTH,
+  PROP_DITHER,
+  PROP_TARGET_FRAMERATE,
+  PROP_KEYFRAMES_ONLY,
+  PROP_SKIPPED_NON_REFERENCE,
+  PROP_SKIPPED_NON_IRAP,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
   PROP_LAST
 };
 
+#define GST_TYPE_OPENHEVC_THREAD_TYPE (gst_openhevc_thread_type_get_type ())
+static GType
+gst_openhevc_thread_type_get_type (void)
+{
+  static volatile gsize thread_type_type = 0;
+
+  if (g_once_init_enter (&thread_type_type)) {
+    static const GEnumValue thread_types[] = {
+      {GST_OPENHEVC_THREAD_AUTO,
+          "Frame+slice for non-live upstream, slice for live", "auto"},
+      {GST_OPENHEVC_THREAD_FRAME, "Frame threading", "frame"},
+      {GST_OPENHEVC_THREAD_SLICE, "Slice threading", "slice"},
+      {GST_OPENHEVC_THREAD_FRAME_SLICE, "Frame and slice threading",
+          "frame+slice"},
+      {0, NULL, NULL},
+    };
+    GType tmp =
+        g_enum_register_static ("GstOpenHEVCThreadType", thread_types);
+
+    g_once_init_leave (&thread_type_type, tmp);
+  }
+
+  return (GType) thread_type_type;
+}
+
+#define GST_TYPE_OPENHEVC_OUTPUT_SCALE (gst_openhevc_output_scale_get_type ())
+static GType
+gst_openhevc_output_scale_get_type (void)
+{
+  static volatile gsize output_scale_type = 0;
+
+  if (g_once_init_enter (&output_scale_type)) {
+    static const GEnumValue output_scales[] = {
+      {GST_OPENHEVC_OUTPUT_SCALE_NONE, "Full resolution", "none"},
+      {GST_OPENHEVC_OUTPUT_SCALE_HALF, "Half width and height", "1/2"},
+      {GST_OPENHEVC_OUTPUT_SCALE_QUARTER, "Quarter width and height", "1/4"},
+      {GST_OPENHEVC_OUTPUT_SCALE_EIGHTH, "Eighth width and height", "1/8"},
+      {0, NULL, NULL},
+    };
+    GType tmp =
+        g_enum_register_static ("GstOpenHEVCOutputScale", output_scales);
+
+    g_once_init_leave (&output_scale_type, tmp);
+  }
+
+  return (GType) output_scale_type;
+}
+
+#define GST_TYPE_OPENHEVC_OUTPUT_DEPTH (gst_openhevc_output_depth_get_type ())
+static GType
+gst_openhevc_output_depth_get_type (void)
+{
+  static volatile gsize output_depth_type = 0;
+
+  if (g_once_init_enter (&output_depth_type)) {
+    static const GEnumValue output_depths[] = {
+      {GST_OPENHEVC_OUTPUT_DEPTH_NATIVE, "Bit depth of the stream", "native"},
+      {GST_OPENHEVC_OUTPUT_DEPTH_8, "8 bit", "8"},
+      {0, NULL, NULL},
+    };
+    GType tmp =
+        g_enum_register_static ("GstOpenHEVCOutputDepth", output_depths);
+
+    g_once_init_leave (&output_depth_type, tmp);
+  }
+
+  return (GType) output_depth_type;
+}
+
 G_DEFINE_TYPE (GstOpenHEVCVidDec, gst_openhevcviddec, GST_TYPE_VIDEO_DECODER);
 
 static void gst_openhevcviddec_finalize (GObject * object);
@@ -74,6 +213,9 @@ static gboolean gst_openhevcviddec_negotiate (GstOpenHEVCVidDec * openhevcdec);
 static GstFlowReturn gst_openhevcviddec_finish (GstVideoDecoder * decoder);
 static GstFlowReturn gst_openhevcviddec_drain (GstVideoDecoder * decoder);
 
+static void gst_openhevcviddec_free_copy_pool (GstOpenHEVCVidDec * openhevcdec);
+static void gst_openhevcviddec_free_arena (GstOpenHEVCVidDec * openhevcdec);
+
 #define GST_FFDEC_PARAMS_QDATA g_quark_from_static_string("openhevcdec-params")
 
 static GstElementClass *parent_class = NULL;
@@ -82,14 +224,16 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("video/x-h265, "
-        "stream-format=(string)byte-stream"//, "
-//        "alignment=(string)au"
-                     ));
+        "stream-format=(string)byte-stream; "
+        /* OpenHEVC needs whole access units */
+        "video/x-h265, "
+        "stream-format=(string){ hvc1, hev1 }, alignment=(string)au"));
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS ("video/x-raw,format={ (string)I420, (string)I420_10LE }"));
+    GST_STATIC_CAPS ("video/x-raw,format={ (string)I420, (string)NV12, "
+        "(string)NV21, (string)I420_10LE }"));
 
 static void
 gst_openhevcviddec_class_init (GstOpenHEVCVidDecClass * klass)
@@ -124,6 +268,62 @@ gst_openhevcviddec_class_init (GstOpenHEVCVidDecClass * klass)
           0, G_MAXINT, DEFAULT_MAX_THREADS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_THREAD_TYPE,
+      g_param_spec_enum ("thread-type", "Thread type",
+          "Multithreading method to use (auto = depending on upstream liveness)",
+          GST_TYPE_OPENHEVC_THREAD_TYPE, DEFAULT_THREAD_TYPE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Disable frame threading so pictures are output as soon as the "
+          "reordering of the stream allows",
+          DEFAULT_LOW_LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_REUSE_HANDLES,
+      g_param_spec_boolean ("reuse-handles", "Reuse handles",
+          "Keep the started decoder and its threads around for a while "
+          "after stopping, for other decoders with the same threading "
+          "configuration that have this enabled",
+          DEFAULT_REUSE_HANDLES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SHARED_POOL,
+      g_param_spec_boolean ("shared-pool", "Shared pool",
+          "Share one thread per core with the other decoders of the process "
+          "that have this enabled, max-threads=0 then creates a share of "
+          "them fixed at start. Takes effect on the next start",
+          DEFAULT_SHARED_POOL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_SHARED_POOL_SIZE, g_param_spec_uint ("shared-pool-size",
+          "Shared pool size",
+          "With shared-pool, number of decoders expected to share the "
+          "threads, which sizes the share of this one (0 = the ones started "
+          "so far). Takes effect on the next start",
+          0, G_MAXUINT, DEFAULT_SHARED_POOL_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "With shared-pool, decoders with a higher priority get to decode "
+          "first when all threads are busy",
+          G_MININT, G_MAXINT, DEFAULT_PRIORITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_CPU_AFFINITY,
+      g_param_spec_string ("cpu-affinity", "CPU affinity",
+          "List of CPUs like \"0-7,16\" to bind the decoder threads to "
+          "(empty = those of numa-node). Takes effect with the next caps",
+          DEFAULT_CPU_AFFINITY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_NUMA_NODE,
+      g_param_spec_int ("numa-node", "NUMA node",
+          "NUMA node to allocate output buffers on, and to bind the decoder "
+          "threads to unless cpu-affinity is set (-1 = any). Takes effect "
+          "with the next caps and allocation",
+          -1, G_MAXINT, DEFAULT_NUMA_NODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_QUALITY_LAYER_ID,
       g_param_spec_int ("quality-layer-id", "Quality Layer ID",
           "The HEVC quality layer to decode",
@@ -136,6 +336,83 @@ gst_openhevcviddec_class_init (GstOpenHEVCVidDecClass * klass)
           0, G_MAXINT, DEFAULT_TEMPORAL_LAYER_ID,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_PARALLEL_COPY_THRESHOLD,
+      g_param_spec_uint64 ("parallel-copy-threshold", "Parallel copy threshold",
+          "Output frame size in bytes from which copying out decoded pictures "
+          "is split across multiple threads (0 = never)",
+          0, G_MAXUINT64, DEFAULT_PARALLEL_COPY_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_MAX_MEMORY,
+      g_param_spec_uint64 ("max-memory", "Maximum memory",
+          "Maximum size in bytes of the output buffer pool, never less than "
+          "what the DPB, frame threads and downstream need (0 = unlimited)",
+          0, G_MAXUINT64, DEFAULT_MAX_MEMORY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_OUTPUT_SCALE,
+      g_param_spec_enum ("output-scale", "Output scale",
+          "Output a reduced resolution, box filtered while copying out the "
+          "decoded pictures. Takes effect with the next picture",
+          GST_TYPE_OPENHEVC_OUTPUT_SCALE, DEFAULT_OUTPUT_SCALE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_OUTPUT_DEPTH,
+      g_param_spec_enum ("output-depth", "Output depth",
+          "Reduce 10 bit 4:2:0 streams to 8 bit while copying out the decoded "
+          "pictures, so I420, NV12 or NV21 can be output. Takes effect with "
+          "the next picture",
+          GST_TYPE_OPENHEVC_OUTPUT_DEPTH, DEFAULT_OUTPUT_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_DITHER,
+      g_param_spec_boolean ("dither", "Dither",
+          "Apply an ordered dither instead of rounding when output-depth "
+          "reduces the bit depth at full resolution",
+          DEFAULT_DITHER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_TARGET_FRAMERATE,
+      gst_param_spec_fraction ("target-framerate", "Target framerate",
+          "Only decode the temporal sub-layers and pictures needed for this "
+          "framerate (0/1 = all)", 0, 1, G_MAXINT, 1, 0, 1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_KEYFRAMES_ONLY,
+      g_param_spec_boolean ("keyframes-only", "Keyframes only",
+          "Only decode IRAP (IDR, CRA and BLA) pictures, like for segments "
+          "with the trickmode-key-units flag",
+          DEFAULT_KEYFRAMES_ONLY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_SKIPPED_NON_REFERENCE,
+      g_param_spec_uint64 ("skipped-non-reference",
+          "Skipped non-reference pictures",
+          "Number of sub-layer non-reference pictures not decoded because "
+          "of QoS", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_SKIPPED_NON_IRAP,
+      g_param_spec_uint64 ("skipped-non-irap", "Skipped non-IRAP pictures",
+          "Number of pictures not decoded because of QoS while waiting for "
+          "the next IRAP picture", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Frame counters, threading configuration and decode rate",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Interval in nanoseconds at which to post the stats as element "
+          "message (0 = never)", 0, G_MAXUINT64, DEFAULT_STATS_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_metadata (element_class, "OpenHEVC decoder",
       "Codec/Decoder/Video", "OpenHEVC decoder",
       "Matthew Waters <matthew@centricular.com>");
@@ -148,6 +425,31 @@ gst_openhevcviddec_init (GstOpenHEVCVidDec * openhevcdec)
 {
   /* some openhevc data */
   openhevcdec->opened = FALSE;
+  openhevcdec->max_threads = DEFAULT_MAX_THREADS;
+  openhevcdec->thread_type = DEFAULT_THREAD_TYPE;
+  openhevcdec->low_latency = DEFAULT_LOW_LATENCY;
+  openhevcdec->reuse_handles = DEFAULT_REUSE_HANDLES;
+  openhevcdec->shared_pool = DEFAULT_SHARED_POOL;
+  openhevcdec->shared_pool_size = DEFAULT_SHARED_POOL_SIZE;
+  openhevcdec->priority = DEFAULT_PRIORITY;
+  openhevcdec->cpu_affinity = DEFAULT_CPU_AFFINITY;
+  openhevcdec->numa_node = DEFAULT_NUMA_NODE;
+  openhevcdec->out_numa_node = -1;
+  openhevcdec->latency_min = GST_CLOCK_TIME_NONE;
+  openhevcdec->latency_max = GST_CLOCK_TIME_NONE;
+  openhevcdec->temporal_layer_id = DEFAULT_TEMPORAL_LAYER_ID;
+  openhevcdec->quality_layer_id = DEFAULT_QUALITY_LAYER_ID;
+  openhevcdec->target_fps_n = 0;
+  openhevcdec->target_fps_d = 1;
+  openhevcdec->parallel_copy_threshold = DEFAULT_PARALLEL_COPY_THRESHOLD;
+  openhevcdec->max_memory = DEFAULT_MAX_MEMORY;
+  openhevcdec->output_scale = DEFAULT_OUTPUT_SCALE;
+  openhevcdec->keyframes_only = DEFAULT_KEYFRAMES_ONLY;
+  openhevcdec->cur_output_scale = DEFAULT_OUTPUT_SCALE;
+  openhevcdec->output_depth = DEFAULT_OUTPUT_DEPTH;
+  openhevcdec->cur_output_depth = DEFAULT_OUTPUT_DEPTH;
+  openhevcdec->dither = DEFAULT_DITHER;
+  gst_openhevc_frame_table_init (&openhevcdec->pending_frames);
 
   gst_video_decoder_set_needs_format (GST_VIDEO_DECODER (openhevcdec), TRUE);
 }
@@ -199,29 +501,162 @@ gst_openhevc_log_callback (void *ptr, int level, const char *fmt, va_list vl)
 }
 #endif
 
+/* a handle that failed to decode something might be left in a state the
+ * next stream shouldn't start from, so it is never reused */
 static void
 gst_openhevc_close_handle (GstOpenHEVCVidDec * openhevcdec)
 {
   if (openhevcdec->hevc_handle != NULL) {
-    oh_close (openhevcdec->hevc_handle);
+    if (openhevcdec->reuse_handles && !openhevcdec->handle_failed)
+      gst_openhevc_handle_pool_release (openhevcdec->hevc_handle,
+          openhevcdec->n_threads, openhevcdec->cur_thread_type,
+          openhevcdec->cur_cpus);
+    else
+      oh_close (openhevcdec->hevc_handle);
     openhevcdec->hevc_handle = NULL;
   }
 }
 
+/* with LOCK */
+static void
+gst_openhevc_choose_threading (GstOpenHEVCVidDec * openhevcdec,
+    gboolean is_live, int *n_threads, GstOpenHEVCThreadType * thread_type)
+{
+  if (openhevcdec->max_threads > 0)
+    *n_threads = openhevcdec->max_threads;
+  else if (openhevcdec->in_shared_pool)
+    *n_threads = openhevcdec->shared_threads;
+  else
+    /* same cap libavcodec applies to automatic thread counts */
+    *n_threads = MIN (g_get_num_processors (), 16);
+
+  if (openhevcdec->low_latency)
+    /* OpenHEVC outputs a picture as soon as more than
+     * sps_max_num_reorder_pics are waiting, frame threading would hold it
+     * back for another frame per thread */
+    *thread_type = GST_OPENHEVC_THREAD_SLICE;
+  else if (openhevcdec->thread_type != GST_OPENHEVC_THREAD_AUTO)
+    *thread_type = openhevcdec->thread_type;
+  else if (is_live)
+    /* frame threading adds a frame of latency per thread */
+    *thread_type = GST_OPENHEVC_THREAD_SLICE;
+  else
+    *thread_type = GST_OPENHEVC_THREAD_FRAME_SLICE;
+}
+
+/* Number of frames of delay OpenHEVC's frame threading adds on top of the
+ * reordering delay */
+static gint
+gst_openhevc_threading_delay (GstOpenHEVCVidDec * openhevcdec)
+{
+  if (openhevcdec->cur_thread_type == GST_OPENHEVC_THREAD_FRAME ||
+      openhevcdec->cur_thread_type == GST_OPENHEVC_THREAD_FRAME_SLICE)
+    return MAX (openhevcdec->n_threads - 1, 0);
+
+  return 0;
+}
+
+/* Number of threads a decode call keeps busy: all of them with slice
+ * threading, and with frame threading the others continue decoding the
+ * previous frames while it runs */
+static guint
+gst_openhevc_threads_per_call (GstOpenHEVCVidDec * openhevcdec)
+{
+  return MAX (openhevcdec->n_threads, 1);
+}
+
+/* Reports the latency OpenHEVC's output adds.  It outputs a picture once
+ * more than sps_max_num_reorder_pics pictures wait for output, or once one
+ * of them waited SpsMaxLatencyPictures or the DPB is full.  Until the SPS
+ * is known, assume a frame worth of reordering for possible b frames.
+ * Frame threading delays the output by a frame per additional thread on
+ * top of that. */
+static void
+gst_openhevcviddec_update_latency (GstOpenHEVCVidDec * openhevcdec)
+{
+  GstVideoInfo *info = NULL;
+  guint min_frames, max_frames, delay;
+  GstClockTime min, max;
+
+  if (openhevcdec->input_state && openhevcdec->input_state->info.fps_n > 0)
+    info = &openhevcdec->input_state->info;
+  else if (openhevcdec->output_state
+      && openhevcdec->output_state->info.fps_n > 0)
+    info = &openhevcdec->output_state->info;
+
+  if (info == NULL)
+    return;
+
+  delay = gst_openhevc_threading_delay (openhevcdec);
+  if (openhevcdec->sps.max_sub_layers > 0) {
+    min_frames = openhevcdec->sps.max_num_reorder_pics;
+    if (openhevcdec->sps.max_latency_pictures > 0)
+      max_frames = openhevcdec->sps.max_latency_pictures;
+    else
+      max_frames = openhevcdec->sps.max_dec_pic_buffering - 1;
+    max_frames = MAX (max_frames, min_frames);
+  } else {
+    min_frames = max_frames = 1;
+  }
+
+  min = gst_util_uint64_scale_ceil ((min_frames + delay) * GST_SECOND,
+      info->fps_d, info->fps_n);
+  max = gst_util_uint64_scale_ceil ((max_frames + delay) * GST_SECOND,
+      info->fps_d, info->fps_n);
+
+  if (min == openhevcdec->latency_min && max == openhevcdec->latency_max)
+    return;
+
+  GST_DEBUG_OBJECT (openhevcdec, "latency of %u-%u frames (%u from threading)"
+      ", min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT, min_frames + delay,
+      max_frames + delay, delay, GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+
+  openhevcdec->latency_min = min;
+  openhevcdec->latency_max = max;
+  gst_video_decoder_set_latency (GST_VIDEO_DECODER (openhevcdec), min, max);
+}
+
+/* The worker threads OpenHEVC spawns in oh_init() and oh_start() inherit
+ * the affinity of the streaming thread, which is bound to cur_cpus
+ * meanwhile */
 static void
 gst_openhevc_open_handle (GstOpenHEVCVidDec * openhevcdec)
 {
+  gboolean started = TRUE;
+  gpointer saved_affinity = NULL;
+
   g_return_if_fail (openhevcdec->hevc_handle == NULL);
 
-  /* FIXME: set threads and thread type */
-  openhevcdec->hevc_handle = oh_init (1, 1);
+  openhevcdec->handle_failed = FALSE;
+  if (openhevcdec->reuse_handles)
+    openhevcdec->hevc_handle =
+        gst_openhevc_handle_pool_acquire (openhevcdec->n_threads,
+        openhevcdec->cur_thread_type, openhevcdec->cur_cpus);
+  if (openhevcdec->hevc_handle == NULL) {
+    saved_affinity =
+        gst_openhevc_placement_bind_thread (openhevcdec->cur_cpus);
+    openhevcdec->hevc_handle = oh_init (openhevcdec->n_threads,
+        openhevcdec->cur_thread_type);
+    if (openhevcdec->hevc_handle == NULL) {
+      gst_openhevc_placement_restore_thread (saved_affinity);
+      return;
+    }
+    started = FALSE;
 #ifndef GST_DISABLE_GST_DEBUG
-  oh_set_log_level(openhevcdec->hevc_handle, OHEVC_LOG_VERBOSE);
-  oh_set_log_callback (openhevcdec->hevc_handle, gst_openhevc_log_callback);
+    oh_set_log_level(openhevcdec->hevc_handle, OHEVC_LOG_VERBOSE);
+    oh_set_log_callback (openhevcdec->hevc_handle, gst_openhevc_log_callback);
 #endif
+  }
   oh_select_active_layer (openhevcdec->hevc_handle, openhevcdec->quality_layer_id);
   oh_select_view_layer (openhevcdec->hevc_handle, openhevcdec->quality_layer_id);
   oh_select_temporal_layer (openhevcdec->hevc_handle, openhevcdec->temporal_layer_id);
+  openhevcdec->cur_temporal_layer_id = openhevcdec->temporal_layer_id;
+  openhevcdec->cur_quality_layer_id = openhevcdec->quality_layer_id;
+
+  if (!started) {
+    oh_start (openhevcdec->hevc_handle);
+    gst_openhevc_placement_restore_thread (saved_affinity);
+  }
 }
 
 static void
@@ -230,10 +665,26 @@ gst_openhevcviddec_finalize (GObject * object)
   GstOpenHEVCVidDec *openhevcdec = (GstOpenHEVCVidDec *) object;
 
   gst_openhevc_close_handle (openhevcdec);
+  gst_openhevcviddec_free_copy_pool (openhevcdec);
+  gst_openhevcviddec_free_arena (openhevcdec);
+  g_free (openhevcdec->cpu_affinity);
+  g_free (openhevcdec->cur_cpus);
+  gst_openhevc_stats_release (&openhevcdec->tracer_stats);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gst_openhevcviddec_reset_stream_format (GstOpenHEVCVidDec * openhevcdec)
+{
+  openhevcdec->nal_length_size = 0;
+  if (openhevcdec->parameter_sets) {
+    g_byte_array_unref (openhevcdec->parameter_sets);
+    openhevcdec->parameter_sets = NULL;
+  }
+  openhevcdec->parameter_sets_pending = FALSE;
+}
+
 /* with LOCK */
 static gboolean
 gst_openhevcviddec_close (GstOpenHEVCVidDec * openhevcdec, gboolean reset)
@@ -250,6 +701,21 @@ gst_openhevcviddec_close (GstOpenHEVCVidDec * openhevcdec, gboolean reset)
     openhevcdec->extradata = NULL;
   }
 
+  gst_openhevcviddec_reset_stream_format (openhevcdec);
+
+  openhevcdec->max_temporal_id = 0;
+  openhevcdec->irap_only = FALSE;
+  openhevcdec->skip_rasl = FALSE;
+
+  memset (&openhevcdec->sps, 0, sizeof (openhevcdec->sps));
+  openhevcdec->latency_min = GST_CLOCK_TIME_NONE;
+  openhevcdec->latency_max = GST_CLOCK_TIME_NONE;
+  memset (openhevcdec->sub_layer_counts, 0,
+      sizeof (openhevcdec->sub_layer_counts));
+  openhevcdec->sub_layer_total = 0;
+  openhevcdec->decode_max_tid = GST_OPENHEVC_MAX_SUB_LAYERS - 1;
+  openhevcdec->output_credit = 0.;
+
   return TRUE;
 }
 
@@ -261,7 +727,6 @@ gst_openhevcviddec_open (GstOpenHEVCVidDec * openhevcdec)
   if (!openhevcdec->hevc_handle)
     goto could_not_open;
 
-  oh_start(openhevcdec->hevc_handle);
   openhevcdec->opened = TRUE;
 
   GST_LOG_OBJECT (openhevcdec, "Opened OpenHEVC codec");
@@ -324,12 +789,42 @@ _update_frame_info (GstOpenHEVCVidDec * openhevcdec, OHFrameInfo * info)
   return TRUE;
 }
 
+/* Unpacks the parameter sets stored in a HEVCDecoderConfigurationRecord,
+ * they get prepended to the next access unit */
+static gboolean
+gst_openhevcviddec_parse_hvcc (GstOpenHEVCVidDec * openhevcdec,
+    const guint8 * data, gsize size, guint * nal_length_size)
+{
+  GByteArray *ps;
+
+  ps = gst_openhevc_nal_parse_hvcc (data, size, nal_length_size);
+  if (!ps) {
+    GST_WARNING_OBJECT (openhevcdec, "Invalid hvcC of size %" G_GSIZE_FORMAT,
+        size);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (openhevcdec, "NAL length size %u, %u bytes of "
+      "parameter sets", *nal_length_size, ps->len);
+
+  if (openhevcdec->parameter_sets)
+    g_byte_array_unref (openhevcdec->parameter_sets);
+  openhevcdec->parameter_sets = ps;
+  openhevcdec->parameter_sets_pending = ps->len > 0;
+
+  return TRUE;
+}
+
 static gboolean
 gst_openhevcviddec_set_format (GstVideoDecoder * decoder,
     GstVideoCodecState * state)
 {
   GstOpenHEVCVidDec *openhevcdec;
-  GstClockTime latency = GST_CLOCK_TIME_NONE;
+  GstQuery *query;
+  gboolean is_live, reconfigure;
+  int n_threads;
+  GstOpenHEVCThreadType thread_type;
+  gchar *cpus;
   gboolean ret = FALSE;
 
   openhevcdec = (GstOpenHEVCVidDec *) decoder;
@@ -341,15 +836,46 @@ gst_openhevcviddec_set_format (GstVideoDecoder * decoder,
 
   GST_DEBUG_OBJECT (openhevcdec, "set_format called");
 
+  query = gst_query_new_latency ();
+  is_live = FALSE;
+  /* Check if upstream is live. If it isn't we can enable frame based
+   * threading, which is adding latency */
+  if (gst_pad_peer_query (GST_VIDEO_DECODER_SINK_PAD (openhevcdec), query)) {
+    gst_query_parse_latency (query, &is_live, NULL, NULL);
+  }
+  gst_query_unref (query);
+
   GST_OBJECT_LOCK (openhevcdec);
 
-  /* close old session */
-  if (openhevcdec->opened) {
+  gst_openhevc_choose_threading (openhevcdec, is_live, &n_threads,
+      &thread_type);
+  cpus = gst_openhevc_placement_resolve_cpus (openhevcdec->cpu_affinity,
+      openhevcdec->numa_node);
+
+  /* The running decoder picks up new parameter sets inline, so resolution,
+   * profile, framerate or PAR changes (e.g. adaptive streaming rendition
+   * switches) don't need a new handle.  Only the settings oh_init() and
+   * the layer selection take do. */
+  reconfigure = openhevcdec->opened
+      && n_threads == openhevcdec->n_threads
+      && thread_type == openhevcdec->cur_thread_type
+      && g_strcmp0 (cpus, openhevcdec->cur_cpus) == 0
+      && openhevcdec->temporal_layer_id == openhevcdec->cur_temporal_layer_id
+      && openhevcdec->quality_layer_id == openhevcdec->cur_quality_layer_id;
+
+  if (reconfigure) {
+    GST_DEBUG_OBJECT (openhevcdec, "reconfiguring running decoder");
+    gst_openhevcviddec_reset_stream_format (openhevcdec);
+    /* renegotiate with the new input state on the next picture */
+    _reset_frame_info (&openhevcdec->frame_info);
+  } else if (openhevcdec->opened) {
+    /* close old session */
     GST_OBJECT_UNLOCK (openhevcdec);
     gst_openhevcviddec_finish (decoder);
     GST_OBJECT_LOCK (openhevcdec);
     if (!gst_openhevcviddec_close (openhevcdec, TRUE)) {
       GST_OBJECT_UNLOCK (openhevcdec);
+      g_free (cpus);
       return FALSE;
     }
     _reset_frame_info (&openhevcdec->frame_info);
@@ -357,28 +883,74 @@ gst_openhevcviddec_set_format (GstVideoDecoder * decoder,
 
   gst_caps_replace (&openhevcdec->last_caps, state->caps);
 
-  if (!gst_openhevcviddec_open (openhevcdec))
-    goto open_failed;
+  if (!reconfigure) {
+    openhevcdec->n_threads = n_threads;
+    openhevcdec->cur_thread_type = thread_type;
+    g_free (openhevcdec->cur_cpus);
+    openhevcdec->cur_cpus = cpus;
+    cpus = NULL;
+    GST_DEBUG_OBJECT (openhevcdec, "using %d threads with thread type %d "
+        "on CPUs %s (upstream is %slive)", n_threads, thread_type,
+        GST_STR_NULL (openhevcdec->cur_cpus), is_live ? "" : "not ");
+
+    if (!gst_openhevcviddec_open (openhevcdec))
+      goto open_failed;
+  }
+  g_free (cpus);
 
   /* get size and so */
   {
     GstStructure *s;
     const GValue *value, *fps, *par;
     GstBuffer *buf = NULL;
+    const gchar *stream_format;
+    gboolean nalff;
 
     s = gst_caps_get_structure (state->caps, 0);
 
+    stream_format = gst_structure_get_string (s, "stream-format");
+    nalff = g_strcmp0 (stream_format, "hvc1") == 0
+        || g_strcmp0 (stream_format, "hev1") == 0;
+    /* hev1 may come without codec_data and all parameter sets inline */
+    if (nalff)
+      openhevcdec->nal_length_size = 4;
+
     if ((value = gst_structure_get_value (s, "codec_data"))) {
       GstMapInfo map;
 
       buf = gst_value_get_buffer (value);
       gst_buffer_map (buf, &map, GST_MAP_READ);
 
-      /* allocate with enough padding */
-      GST_DEBUG ("copy codec data of size %" G_GSIZE_FORMAT, map.size);
-      oh_extradata_cpy (openhevcdec->hevc_handle, map.data, map.size);
+      if (nalff) {
+        /* converted to byte-stream ourselves, so OpenHEVC only ever
+         * sees Annex B */
+        if (!gst_openhevcviddec_parse_hvcc (openhevcdec, map.data, map.size,
+                &openhevcdec->nal_length_size)) {
+          gst_buffer_unmap (buf, &map);
+          goto open_failed;
+        }
+      } else {
+        guint unused;
+
+        /* extradata is only parsed by oh_start() which already happened
+         * for a reused or reconfigured handle, send it inline instead.
+         * Either a HEVCDecoderConfigurationRecord or Annex B already */
+        if (map.size < 1 || map.data[0] != 1
+            || !gst_openhevcviddec_parse_hvcc (openhevcdec, map.data,
+                map.size, &unused)) {
+          if (openhevcdec->parameter_sets)
+            g_byte_array_unref (openhevcdec->parameter_sets);
+          openhevcdec->parameter_sets = g_byte_array_sized_new (map.size);
+          g_byte_array_append (openhevcdec->parameter_sets, map.data,
+              map.size);
+          openhevcdec->parameter_sets_pending = map.size > 0;
+        }
+      }
 
       gst_buffer_unmap (buf, &map);
+    } else if (g_strcmp0 (stream_format, "hvc1") == 0) {
+      GST_ERROR_OBJECT (openhevcdec, "hvc1 requires codec_data");
+      goto open_failed;
     } else {
       GST_INFO_OBJECT (openhevcdec, "no codec data");
     }
@@ -438,29 +1010,6 @@ gst_openhevcviddec_set_format (GstVideoDecoder * decoder,
     openhevcdec->frame_info.framerate.den = 25;
   }
 
-  {
-#if 0
-    GstQuery *query;
-    gboolean is_live;
-
-    /* FIXME: choose the number of threads and thread type based on
-     * openhevcdec->max_threads; */
-
-    query = gst_query_new_latency ();
-    is_live = FALSE;
-    /* Check if upstream is live. If it isn't we can enable frame based
-     * threading, which is adding latency */
-    if (gst_pad_peer_query (GST_VIDEO_DECODER_SINK_PAD (openhevcdec), query)) {
-      gst_query_parse_latency (query, &is_live, NULL, NULL);
-    }
-    gst_query_unref (query);
-
-    if (is_live)
-      openhevcdec->context->thread_type = FF_THREAD_SLICE;
-    else
-      openhevcdec->context->thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
-#endif
-  }
   /* open codec - we don't select an output pix_fmt yet,
    * simply because we don't know! We only get it
    * during playback... */
@@ -469,21 +1018,13 @@ gst_openhevcviddec_set_format (GstVideoDecoder * decoder,
     gst_video_codec_state_unref (openhevcdec->input_state);
   openhevcdec->input_state = gst_video_codec_state_ref (state);
 
-  if (openhevcdec->input_state->info.fps_n) {
-    GstVideoInfo *info = &openhevcdec->input_state->info;
-    /* defualt to adding a frame worth of latancy for possible b frames */
-    latency = gst_util_uint64_scale_ceil (
-        (1) * GST_SECOND, info->fps_d,
-        info->fps_n);
-  }
-
   ret = TRUE;
 
 done:
   GST_OBJECT_UNLOCK (openhevcdec);
 
-  if (GST_CLOCK_TIME_IS_VALID (latency))
-    gst_video_decoder_set_latency (decoder, latency, latency);
+  if (ret)
+    gst_openhevcviddec_update_latency (openhevcdec);
 
   return ret;
 
@@ -600,22 +1141,41 @@ gst_openhevcviddec_negotiate (GstOpenHEVCVidDec * openhevcdec)
   GstVideoFormat fmt;
   GstVideoInfo *in_info, *out_info;
   GstVideoCodecState *output_state;
+  GstVideoFormat native;
+  GstCaps *allowed;
   gint fps_n, fps_d;
-  GstClockTime latency;
+  guint scale;
   OHFrameInfo new;
 //  GstStructure *in_s;
 
   oh_frameinfo_update (openhevcdec->hevc_handle, &new);
 
   /* no change in format */
-  if (!_update_frame_info (openhevcdec, &new))
+  if (!_update_frame_info (openhevcdec, &new)
+      && openhevcdec->output_scale == openhevcdec->cur_output_scale
+      && openhevcdec->output_depth == openhevcdec->cur_output_depth)
     return TRUE;
 
-  fmt = video_format_from_chromat_format (openhevcdec->frame_info.chromat_format, openhevcdec->frame_info.bitdepth);
+  native = video_format_from_chromat_format (openhevcdec->frame_info.chromat_format, openhevcdec->frame_info.bitdepth);
+  openhevcdec->cur_output_depth = openhevcdec->output_depth;
+  allowed = gst_pad_get_allowed_caps (GST_VIDEO_DECODER_SRC_PAD (openhevcdec));
+  fmt = gst_openhevc_output_choose_format (native,
+      openhevcdec->cur_output_depth, allowed);
+  if (allowed)
+    gst_caps_unref (allowed);
+  openhevcdec->output_format = fmt;
+
+  GST_DEBUG_OBJECT (openhevcdec, "Chose output format %s for native %s",
+      gst_video_format_to_string (fmt), gst_video_format_to_string (native));
+
+  /* the aspect ratio stays the same, both dimensions are scaled */
+  scale = openhevcdec->cur_output_scale = openhevcdec->output_scale;
 
   output_state =
       gst_video_decoder_set_output_state (GST_VIDEO_DECODER (openhevcdec), fmt,
-      openhevcdec->frame_info.width, openhevcdec->frame_info.height, openhevcdec->input_state);
+      (openhevcdec->frame_info.width + scale - 1) / scale,
+      (openhevcdec->frame_info.height + scale - 1) / scale,
+      openhevcdec->input_state);
   if (openhevcdec->output_state)
     gst_video_codec_state_unref (openhevcdec->output_state);
   openhevcdec->output_state = output_state;
@@ -799,14 +1359,10 @@ gst_openhevcviddec_negotiate (GstOpenHEVCVidDec * openhevcdec)
 #endif
   if (!gst_video_decoder_negotiate (GST_VIDEO_DECODER (openhevcdec)))
     goto negotiate_failed;
+  g_atomic_int_inc (&openhevcdec->counters.renegotiations);
 
   /* The decoder is configured, we now know the true latency */
-  if (fps_n) {
-    latency =
-        gst_util_uint64_scale_ceil (GST_SECOND, fps_d, fps_n);
-    gst_video_decoder_set_latency (GST_VIDEO_DECODER (openhevcdec), latency,
-        latency);
-  }
+  gst_openhevcviddec_update_latency (openhevcdec);
 
   return TRUE;
 #if 0
@@ -828,22 +1384,93 @@ unknown_format:
   }
 }
 
+static GstTaskPool *
+gst_openhevcviddec_get_copy_pool (GstOpenHEVCVidDec * openhevcdec)
+{
+  GError *error = NULL;
+
+  if (openhevcdec->copy_pool)
+    return openhevcdec->copy_pool;
+
+  openhevcdec->copy_pool = gst_task_pool_new ();
+  gst_task_pool_prepare (openhevcdec->copy_pool, &error);
+  if (error) {
+    GST_WARNING_OBJECT (openhevcdec, "Failed to prepare copy thread pool: %s",
+        error->message);
+    g_clear_error (&error);
+    gst_object_unref (openhevcdec->copy_pool);
+    openhevcdec->copy_pool = NULL;
+  }
+
+  return openhevcdec->copy_pool;
+}
+
+static void
+gst_openhevcviddec_free_copy_pool (GstOpenHEVCVidDec * openhevcdec)
+{
+  if (openhevcdec->copy_pool) {
+    gst_task_pool_cleanup (openhevcdec->copy_pool);
+    gst_object_unref (openhevcdec->copy_pool);
+    openhevcdec->copy_pool = NULL;
+  }
+}
+
+/* Executes the per plane @jobs, splitting them into bands of rows that are
+ * copied in parallel for frames of at least parallel-copy-threshold bytes */
+static void
+gst_openhevcviddec_run_copy_jobs (GstOpenHEVCVidDec * openhevcdec,
+    GstOpenHEVCCopyJob * jobs, guint n_jobs, gsize frame_size)
+{
+  GstTaskPool *pool = NULL;
+  guint n_bands, n_split;
+
+  n_bands = MIN (g_get_num_processors (), GST_OPENHEVC_OUTPUT_MAX_BANDS);
+
+  if (openhevcdec->parallel_copy_threshold > 0
+      && frame_size >= openhevcdec->parallel_copy_threshold && n_bands > 1)
+    pool = gst_openhevcviddec_get_copy_pool (openhevcdec);
+
+  n_split = gst_openhevc_output_run_jobs (jobs, n_jobs, pool, n_bands);
+
+  GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, openhevcdec,
+      "copied frame of %" G_GSIZE_FORMAT " bytes in %u bands", frame_size,
+      n_split);
+}
+
+/* Copies @frame into a buffer from the negotiated pool.
+ *
+ * Decoding directly into pool buffers is not possible: OpenHEVC allocates
+ * its pictures internally and its API has neither a get_buffer() style
+ * callback nor a way to hand it external picture storage, and it keeps
+ * reading reference pictures after they have been output.  Its output
+ * pictures can't be handed downstream either, they are only valid until the
+ * next call into the decoder and it has no way of holding a reference on
+ * them. */
 static gboolean
 copy_frame_to_codec_frame (GstOpenHEVCVidDec * openhevcdec, OHFrame * frame, GstVideoCodecFrame * out_frame)
 {
   GstFlowReturn ret;
-  GstVideoInfo dst_info;
+  GstVideoInfo src_info, dst_info;
   GstVideoFrame dst_frame;
+  GstOpenHEVCCopyJob jobs[GST_VIDEO_MAX_PLANES];
+  const guint8 *src[3];
+  gsize src_stride[3];
   gboolean res = FALSE;
-  gsize p;
+  guint scale = openhevcdec->cur_output_scale;
+  guint n_jobs;
 
   ret = gst_video_decoder_allocate_output_frame (GST_VIDEO_DECODER (openhevcdec), out_frame);
   if (ret != GST_FLOW_OK)
     goto error;
 
-  if (!gst_video_info_set_format (&dst_info,
-      video_format_from_chromat_format (frame->frame_par.chromat_format, frame->frame_par.bitdepth),
-      frame->frame_par.width, frame->frame_par.height)) {
+  /* the decoder's planes, and the output format */
+  if (!gst_video_info_set_format (&src_info,
+      video_format_from_chromat_format (frame->frame_par.chromat_format,
+          frame->frame_par.bitdepth),
+      frame->frame_par.width, frame->frame_par.height) ||
+      !gst_video_info_set_format (&dst_info, openhevcdec->output_format,
+      (frame->frame_par.width + scale - 1) / scale,
+      (frame->frame_par.height + scale - 1) / scale)) {
     GST_ERROR_OBJECT (openhevcdec, "Could not set destination video info");
     goto error;
   }
@@ -853,32 +1480,21 @@ copy_frame_to_codec_frame (GstOpenHEVCVidDec * openhevcdec, OHFrame * frame, Gst
     goto error;
   }
 
-  for (p = 0; p < GST_VIDEO_FRAME_N_PLANES (&dst_frame); p++) {
-    /* plane 0 */
-    gsize src_pos = 0, dst_pos = 0;
-    guint8 * dst = dst_frame.data[p];
-    gsize dst_stride = GST_VIDEO_FRAME_COMP_STRIDE (&dst_frame, p);
-    guint8 * src;
-    gsize src_stride;
-    gsize l;
-
-    if (p == 0) {
-      src = (guint8 *) frame->data_y_p;
-      src_stride = frame->frame_par.linesize_y;
-    } else if (p == 1) {
-      src = (guint8 *) frame->data_cb_p;
-      src_stride = frame->frame_par.linesize_cb;
-    } else if (p == 2) {
-      src = (guint8 *) frame->data_cr_p;
-      src_stride = frame->frame_par.linesize_cr;
-    }
+  /* the planes start at the conformance window, so the copy only reads
+   * the visible region and crops for free */
+  src[0] = frame->data_y_p;
+  src[1] = frame->data_cb_p;
+  src[2] = frame->data_cr_p;
+  src_stride[0] = frame->frame_par.linesize_y;
+  src_stride[1] = frame->frame_par.linesize_cb;
+  src_stride[2] = frame->frame_par.linesize_cr;
 
-    for (l = 0; l < GST_VIDEO_FRAME_COMP_HEIGHT (&dst_frame, p); l++) {
-      memcpy (&dst[dst_pos], &src[src_pos], GST_VIDEO_FRAME_COMP_STRIDE (&dst_frame, p));
-      src_pos += src_stride;
-      dst_pos += dst_stride;
-    }
-  }
+  n_jobs = gst_openhevc_output_build_jobs (jobs, &dst_frame, &src_info, src,
+      src_stride, scale, openhevcdec->dither);
+
+  /* the work is reading the source, split it by how much of that there is */
+  gst_openhevcviddec_run_copy_jobs (openhevcdec, jobs, n_jobs,
+      GST_VIDEO_INFO_SIZE (&src_info));
 
   gst_video_frame_unmap (&dst_frame);
 
@@ -895,6 +1511,26 @@ error:
   goto done;
 }
 
+/* releases all pending frames older than @system_frame_number */
+static void
+gst_openhevcviddec_release_ghost_frames (GstOpenHEVCVidDec * openhevcdec,
+    guint32 system_frame_number)
+{
+  GstVideoDecoder *dec = GST_VIDEO_DECODER (openhevcdec);
+  GstVideoCodecFrame *tmp;
+
+  while ((tmp = gst_openhevc_frame_table_pop_older (&openhevcdec->pending_frames,
+              system_frame_number))) {
+    GST_LOG_OBJECT (dec,
+        "discarding ghost frame %p (#%d) PTS:%" GST_TIME_FORMAT " DTS:%"
+        GST_TIME_FORMAT, tmp, tmp->system_frame_number,
+        GST_TIME_ARGS (tmp->pts), GST_TIME_ARGS (tmp->dts));
+    /* drop our ref and remove from frame list */
+    gst_video_decoder_release_frame (dec, tmp);
+    g_atomic_int_inc (&openhevcdec->counters.ghost_released);
+  }
+}
+
 /*
  * Returns: whether a frame was decoded
  */
@@ -904,6 +1540,7 @@ gst_openhevcviddec_video_frame (GstOpenHEVCVidDec * openhevcdec,
 {
   int got_frame = FALSE;
   GstVideoCodecFrame *out_frame = NULL;
+  GstClockTime start;
 
   *ret = GST_FLOW_OK;
 
@@ -913,33 +1550,24 @@ gst_openhevcviddec_video_frame (GstOpenHEVCVidDec * openhevcdec,
   } else if (got_frame < 0) {
     *ret = GST_FLOW_OK;
     GST_WARNING_OBJECT (openhevcdec, "Legitimate decoding error");
+    g_atomic_int_inc (&openhevcdec->counters.decode_errors);
+    openhevcdec->handle_failed = TRUE;
     goto beach;
   }
 
-  {
-    GList *l, *ol;
-    GstVideoDecoder *dec = GST_VIDEO_DECODER (openhevcdec);
-
-    GST_TRACE_OBJECT (openhevcdec, "Attempting to find frame with pts: %" G_GUINT64_FORMAT, openhevcdec->frame.frame_par.pts);
-
-    ol = l = gst_video_decoder_get_frames (dec);
-    while (l) {
-      GstVideoCodecFrame *tmp = l->data;
-
-    GST_TRACE_OBJECT (openhevcdec, "checking existing frame with pts: %" G_GUINT64_FORMAT, tmp->pts);
-      if (openhevcdec->frame.frame_par.pts == tmp->pts) {
-        out_frame = tmp;
-      } else {
-        gst_video_codec_frame_unref (tmp);
-      }
-      l = l->next;
-    }
-    g_list_free (ol);
-  }
+  /* we pass the system_frame_number to OpenHEVC as the pts */
+  GST_TRACE_OBJECT (openhevcdec, "Attempting to find frame #%u",
+      (guint32) openhevcdec->frame.frame_par.pts);
+  out_frame = gst_openhevc_frame_table_take (&openhevcdec->pending_frames,
+      (guint32) openhevcdec->frame.frame_par.pts);
   if (!out_frame) {
     got_frame = 0;
     goto beach;
   }
+  GST_OPENHEVC_STATS_RECORD (openhevcdec, &openhevcdec->tracer_stats,
+      GST_OPENHEVC_STAGE_REORDER,
+      openhevcdec->decoded_at[out_frame->system_frame_number &
+          (GST_OPENHEVC_FRAME_TABLE_SIZE - 1)]);
 
   /* Extract auxilliary info not stored in the main AVframe */
   {
@@ -978,8 +1606,11 @@ gst_openhevcviddec_video_frame (GstOpenHEVCVidDec * openhevcdec,
     goto negotiation_error;
 
   gst_buffer_replace (&out_frame->output_buffer, NULL);
+  start = GST_OPENHEVC_STATS_NOW ();
   if (!copy_frame_to_codec_frame (openhevcdec, &openhevcdec->frame, out_frame))
     goto no_output;
+  GST_OPENHEVC_STATS_RECORD (openhevcdec, &openhevcdec->tracer_stats,
+      GST_OPENHEVC_STAGE_COPY, start);
 #if 0
   if (openhevcdec->pic_interlaced) {
     /* set interlaced flags */
@@ -993,41 +1624,20 @@ gst_openhevcviddec_video_frame (GstOpenHEVCVidDec * openhevcdec,
   }
 #endif
   /* cleaning time */
-  /* so we decoded this frame, frames preceding it in decoding order
-   * that still do not have a buffer allocated seem rather useless,
-   * and can be discarded, due to e.g. misparsed bogus frame
-   * or non-keyframe in skipped decoding, ...
+  /* so we decoded this frame, frames preceding it in decoding order by more
+   * than the decoder could possibly hold back can be discarded, due to e.g.
+   * misparsed bogus frame or non-keyframe in skipped decoding, ...
    * In any case, not likely to be seen again, so discard those,
    * before they pile up and/or mess with timestamping */
-  {
-    GList *l, *ol;
-    GstVideoDecoder *dec = GST_VIDEO_DECODER (openhevcdec);
-    gboolean old = TRUE;
-
-    ol = l = gst_video_decoder_get_frames (dec);
-    while (l) {
-      GstVideoCodecFrame *tmp = l->data;
-
-      if (tmp == out_frame)
-        old = FALSE;
-
-      if (old && GST_VIDEO_CODEC_FRAME_IS_DECODE_ONLY (tmp)) {
-        GST_LOG_OBJECT (dec,
-            "discarding ghost frame %p (#%d) PTS:%" GST_TIME_FORMAT " DTS:%"
-            GST_TIME_FORMAT, tmp, tmp->system_frame_number,
-            GST_TIME_ARGS (tmp->pts), GST_TIME_ARGS (tmp->dts));
-        /* drop extra ref and remove from frame list */
-        gst_video_decoder_release_frame (dec, tmp);
-      } else {
-        /* drop extra ref we got */
-        gst_video_codec_frame_unref (tmp);
-      }
-      l = l->next;
-    }
-    g_list_free (ol);
-  }
+  gst_openhevcviddec_release_ghost_frames (openhevcdec,
+      out_frame->system_frame_number - MAX_DPB_SIZE -
+      gst_openhevc_threading_delay (openhevcdec));
 
+  start = GST_OPENHEVC_STATS_NOW ();
   *ret = gst_video_decoder_finish_frame (GST_VIDEO_DECODER (openhevcdec), out_frame);
+  g_atomic_int_inc (&openhevcdec->counters.decoded);
+  GST_OPENHEVC_STATS_RECORD (openhevcdec, &openhevcdec->tracer_stats,
+      GST_OPENHEVC_STAGE_PUSH, start);
 
 beach:
   GST_DEBUG_OBJECT (openhevcdec, "return flow %s, got frame: %d",
@@ -1039,6 +1649,7 @@ no_output:
   {
     GST_DEBUG_OBJECT (openhevcdec, "no output buffer");
     gst_video_decoder_drop_frame (GST_VIDEO_DECODER (openhevcdec), out_frame);
+    g_atomic_int_inc (&openhevcdec->counters.dropped);
     goto beach;
   }
 
@@ -1104,15 +1715,486 @@ gst_openhevcviddec_drain (GstVideoDecoder * decoder)
   return GST_FLOW_OK;
 }
 
+/* Makes sure the input arena can hold @size bytes plus padding */
+static guint8 *
+gst_openhevcviddec_ensure_arena (GstOpenHEVCVidDec * openhevcdec, gsize size)
+{
+  if (openhevcdec->padded_size < size + INPUT_PADDING_SIZE) {
+    /* grow geometrically so that slowly increasing AU sizes don't cause a
+     * reallocation every time */
+    gsize new_size = MAX (size + INPUT_PADDING_SIZE,
+        openhevcdec->padded_size + openhevcdec->padded_size / 2);
+
+    g_free (openhevcdec->padded_mem);
+    openhevcdec->padded_mem = g_malloc (new_size + INPUT_ARENA_ALIGN - 1);
+    openhevcdec->padded = (guint8 *) (((guintptr) openhevcdec->padded_mem +
+            INPUT_ARENA_ALIGN - 1) & ~((guintptr) INPUT_ARENA_ALIGN - 1));
+    openhevcdec->padded_size = new_size;
+    GST_LOG_OBJECT (openhevcdec, "resized padding buffer to %" G_GSIZE_FORMAT,
+        openhevcdec->padded_size);
+  }
+
+  return openhevcdec->padded;
+}
+
+static void
+gst_openhevcviddec_free_arena (GstOpenHEVCVidDec * openhevcdec)
+{
+  g_free (openhevcdec->padded_mem);
+  openhevcdec->padded_mem = NULL;
+  openhevcdec->padded = NULL;
+  openhevcdec->padded_size = 0;
+}
+
+/* Gets @buffer's data into contiguous memory followed by
+ * INPUT_PADDING_SIZE zeroed bytes.  Contiguous and padded input is used
+ * in place and left mapped in @minfo, everything else is gathered into the
+ * input arena in a single pass. */
+static gboolean
+gst_openhevcviddec_prepare_input (GstOpenHEVCVidDec * openhevcdec,
+    GstBuffer * buffer, GstMapInfo * minfo, gboolean * mapped,
+    guint8 ** data, gsize * size)
+{
+  *mapped = FALSE;
+  *size = gst_buffer_get_size (buffer);
+
+  /* parameter sets from a codec_data change go in front */
+  if (openhevcdec->parameter_sets_pending) {
+    guint prefix = openhevcdec->parameter_sets->len;
+
+    *data = gst_openhevcviddec_ensure_arena (openhevcdec, prefix + *size);
+    memcpy (*data, openhevcdec->parameter_sets->data, prefix);
+    if (gst_buffer_extract (buffer, 0, *data + prefix, *size) != *size)
+      return FALSE;
+    *size += prefix;
+    openhevcdec->parameter_sets_pending = FALSE;
+  } else if (gst_buffer_n_memory (buffer) == 1) {
+    if (!gst_buffer_map (buffer, minfo, GST_MAP_READ))
+      return FALSE;
+    *mapped = TRUE;
+
+    if (GST_MEMORY_IS_ZERO_PADDED (minfo->memory)
+        && (minfo->maxsize - minfo->size) >= INPUT_PADDING_SIZE) {
+      *data = minfo->data;
+      return TRUE;
+    }
+
+    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, openhevcdec,
+        "Copy input to add padding");
+    *data = gst_openhevcviddec_ensure_arena (openhevcdec, *size);
+    memcpy (*data, minfo->data, *size);
+  } else {
+    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, openhevcdec,
+        "Gathering input from %u memories", gst_buffer_n_memory (buffer));
+    *data = gst_openhevcviddec_ensure_arena (openhevcdec, *size);
+    if (gst_buffer_extract (buffer, 0, *data, *size) != *size)
+      return FALSE;
+  }
+
+  memset (*data + *size, 0, INPUT_PADDING_SIZE);
+
+  return TRUE;
+}
+
+/* Converts a length prefixed (hvc1/hev1) access unit into byte-stream
+ * format in the input arena, preceded by the parameter sets from the
+ * codec_data if they weren't sent yet.  4 byte length prefixes are replaced
+ * by start codes in place after gathering the input.  Sets @invalid if a
+ * NAL unit length runs past the end of the buffer */
+static gboolean
+gst_openhevcviddec_prepare_nalff_input (GstOpenHEVCVidDec * openhevcdec,
+    GstBuffer * buffer, guint8 ** data, gsize * size, gboolean * invalid)
+{
+  guint len_size = openhevcdec->nal_length_size;
+  gsize in_size = gst_buffer_get_size (buffer);
+  gsize prefix = 0, out_size;
+  guint8 *out;
+
+  *invalid = FALSE;
+
+  if (openhevcdec->parameter_sets_pending)
+    prefix = openhevcdec->parameter_sets->len;
+
+  if (len_size == 4) {
+    out = gst_openhevcviddec_ensure_arena (openhevcdec, prefix + in_size);
+    if (gst_buffer_extract (buffer, 0, out + prefix, in_size) != in_size)
+      return FALSE;
+
+    if (!gst_openhevc_nal_to_byte_stream_in_place (out + prefix, in_size)) {
+      *invalid = TRUE;
+      return TRUE;
+    }
+    out_size = prefix + in_size;
+  } else {
+    GstMapInfo minfo;
+
+    if (!gst_buffer_map (buffer, &minfo, GST_MAP_READ))
+      return FALSE;
+
+    /* start codes are bigger than the prefixes, find the output size first */
+    if (!gst_openhevc_nal_byte_stream_size (minfo.data, minfo.size, len_size,
+            &out_size)) {
+      gst_buffer_unmap (buffer, &minfo);
+      *invalid = TRUE;
+      return TRUE;
+    }
+
+    out_size += prefix;
+    out = gst_openhevcviddec_ensure_arena (openhevcdec, out_size);
+    gst_openhevc_nal_to_byte_stream (minfo.data, minfo.size, len_size,
+        out + prefix);
+
+    gst_buffer_unmap (buffer, &minfo);
+  }
+
+  if (prefix > 0) {
+    memcpy (out, openhevcdec->parameter_sets->data, prefix);
+    openhevcdec->parameter_sets_pending = FALSE;
+  }
+
+  memset (out + out_size, 0, INPUT_PADDING_SIZE);
+  *data = out;
+  *size = out_size;
+
+  return TRUE;
+}
+
+/* Returns the offset of the NAL header following the next start code at or
+ * after @pos, or @size if there is none */
+static gsize
+_next_nal (const guint8 * data, gsize size, gsize pos)
+{
+  while (pos + 3 <= size) {
+    if (data[pos + 2] > 1)
+      pos += 3;
+    else if (data[pos + 2] == 1 && data[pos + 1] == 0 && data[pos] == 0)
+      return pos + 3;
+    else
+      pos++;
+  }
+
+  return size;
+}
+
+/* Finds the first VCL NAL unit of a byte-stream access unit, all VCL NAL
+ * units of a picture share the same type.  Returns FALSE if there is none */
+static gboolean
+_find_first_vcl (const guint8 * data, gsize size, guint * nal_type,
+    guint * temporal_id)
+{
+  gsize pos = 0;
+
+  while ((pos = _next_nal (data, size, pos)) + 2 <= size) {
+    guint type = (data[pos] >> 1) & 0x3f;
+
+    if (type <= NAL_TYPE_RSV_VCL31) {
+      *nal_type = type;
+      /* nuh_temporal_id_plus1 of 0 is forbidden */
+      *temporal_id = MAX (data[pos + 1] & 0x07, 1) - 1;
+      return TRUE;
+    }
+    pos += 2;
+  }
+
+  return FALSE;
+}
+
+/* Returns the offset of the first NAL unit with a type between @first and
+ * @last, or @size if there is none */
+static gsize
+_find_nal (const guint8 * data, gsize size, guint first, guint last)
+{
+  gsize pos = 0;
+
+  while ((pos = _next_nal (data, size, pos)) + 2 <= size) {
+    guint type = (data[pos] >> 1) & 0x3f;
+
+    if (type >= first && type <= last)
+      return pos;
+    pos += 2;
+  }
+
+  return size;
+}
+
+/* Keeps the parameter sets of an access unit that won't be decoded, they
+ * are sent in front of the next one that is */
+static void
+gst_openhevcviddec_keep_parameter_sets (GstOpenHEVCVidDec * openhevcdec,
+    const guint8 * data, gsize size)
+{
+  gsize pos = _next_nal (data, size, 0);
+
+  while (pos + 2 <= size) {
+    guint type = (data[pos] >> 1) & 0x3f;
+    gsize next = _next_nal (data, size, pos + 2);
+
+    if (type >= NAL_TYPE_VPS && type <= NAL_TYPE_PPS) {
+      gsize end = next < size ? next - 3 : size;
+
+      if (!openhevcdec->parameter_sets)
+        openhevcdec->parameter_sets = g_byte_array_new ();
+      else if (!openhevcdec->parameter_sets_pending)
+        /* already sent */
+        g_byte_array_set_size (openhevcdec->parameter_sets, 0);
+
+      g_byte_array_append (openhevcdec->parameter_sets,
+          gst_openhevc_nal_start_code, sizeof (gst_openhevc_nal_start_code));
+      g_byte_array_append (openhevcdec->parameter_sets, data + pos,
+          end - pos);
+      openhevcdec->parameter_sets_pending = TRUE;
+    }
+    pos = next;
+  }
+}
+
+/* with the STREAM_LOCK */
+static gboolean
+gst_openhevcviddec_keyframes_only (GstOpenHEVCVidDec * openhevcdec)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (openhevcdec);
+
+  return openhevcdec->keyframes_only
+      || (decoder->input_segment.flags & GST_SEGMENT_FLAG_TRICKMODE_KEY_UNITS);
+}
+
+static GstClockTime
+gst_openhevcviddec_frame_duration (GstOpenHEVCVidDec * openhevcdec,
+    GstVideoCodecFrame * frame)
+{
+  if (GST_CLOCK_TIME_IS_VALID (frame->duration))
+    return frame->duration;
+
+  if (openhevcdec->input_state && openhevcdec->input_state->info.fps_n > 0)
+    return gst_util_uint64_scale (GST_SECOND,
+        openhevcdec->input_state->info.fps_d,
+        openhevcdec->input_state->info.fps_n);
+
+  return GST_CLOCK_TIME_NONE;
+}
+
+/* Picks up the SPS sent with IRAP access units, the parameter sets of
+ * the codec_data are prepended to the first one */
+static void
+gst_openhevcviddec_update_sps (GstOpenHEVCVidDec * openhevcdec,
+    const guint8 * data, gsize size)
+{
+  GstOpenHEVCSPS sps;
+  gsize pos = _find_nal (data, size, NAL_TYPE_SPS, NAL_TYPE_SPS);
+
+  if (pos >= size)
+    return;
+
+  if (!gst_openhevc_sps_parse (&sps, data + pos, size - pos)) {
+    GST_WARNING_OBJECT (openhevcdec, "failed to parse SPS");
+    return;
+  }
+
+  if (memcmp (&sps, &openhevcdec->sps, sizeof (sps)) == 0)
+    return;
+
+  GST_DEBUG_OBJECT (openhevcdec, "new SPS: %ux%u, %u sub-layers, DPB size "
+      "%u, %u reorder pictures", sps.width, sps.height, sps.max_sub_layers,
+      sps.max_dec_pic_buffering, sps.max_num_reorder_pics);
+  openhevcdec->sps = sps;
+
+  gst_openhevcviddec_update_latency (openhevcdec);
+
+  /* resize the output pool with the next picture */
+  if (openhevcdec->output_state
+      && sps.max_dec_pic_buffering != openhevcdec->pool_dpb_size)
+    gst_pad_mark_reconfigure (GST_VIDEO_DECODER_SRC_PAD (openhevcdec));
+}
+
+/* Framerate of sub-layers 0 to @layer.  Estimated from how often each
+ * TemporalId occurred recently, or assuming a dyadic hierarchy over the
+ * sub-layers of the SPS while there's not enough history */
+static gdouble
+gst_openhevcviddec_sub_layer_rate (GstOpenHEVCVidDec * openhevcdec,
+    guint layer, gdouble input_rate)
+{
+  guint i, n = 0;
+
+  if (openhevcdec->sub_layer_total < SUB_LAYER_STATS_MIN) {
+    guint max_layer = MAX (openhevcdec->sps.max_sub_layers, 1) - 1;
+
+    return input_rate / (1 << (max_layer - MIN (layer, max_layer)));
+  }
+
+  for (i = 0; i <= layer; i++)
+    n += openhevcdec->sub_layer_counts[i];
+
+  return input_rate * n / openhevcdec->sub_layer_total;
+}
+
+/* Decides whether an access unit isn't needed for the target-framerate.
+ * Picks the lowest sub-layer that has at least the target framerate, and
+ * within that sub-layer drops the non-reference pictures not needed to
+ * reach the target.  Sub-layers are only added back at IRAP or (S)TSA
+ * pictures where switching up is allowed. */
+static gboolean
+gst_openhevcviddec_temporal_skip (GstOpenHEVCVidDec * openhevcdec,
+    GstVideoCodecFrame * frame, const guint8 * data, gsize size,
+    guint type, guint tid)
+{
+  gint fps_n, fps_d;
+  GstClockTime duration;
+  gdouble input_rate, target, ratio;
+  guint max_layer, wanted, i;
+  gboolean irap;
+
+  irap = type >= NAL_TYPE_BLA_W_LP && type <= NAL_TYPE_RSV_IRAP_23;
+
+  openhevcdec->sub_layer_counts[tid]++;
+  if (++openhevcdec->sub_layer_total >= SUB_LAYER_STATS_WINDOW) {
+    openhevcdec->sub_layer_total = 0;
+    for (i = 0; i < GST_OPENHEVC_MAX_SUB_LAYERS; i++) {
+      openhevcdec->sub_layer_counts[i] /= 2;
+      openhevcdec->sub_layer_total += openhevcdec->sub_layer_counts[i];
+    }
+  }
+
+  GST_OBJECT_LOCK (openhevcdec);
+  fps_n = openhevcdec->target_fps_n;
+  fps_d = openhevcdec->target_fps_d;
+  GST_OBJECT_UNLOCK (openhevcdec);
+
+  duration = gst_openhevcviddec_frame_duration (openhevcdec, frame);
+  if (fps_n == 0 || !GST_CLOCK_TIME_IS_VALID (duration) || duration == 0) {
+    if (openhevcdec->decode_max_tid < GST_OPENHEVC_MAX_SUB_LAYERS - 1 && irap) {
+      GST_DEBUG_OBJECT (openhevcdec, "decoding all sub-layers again");
+      openhevcdec->decode_max_tid = GST_OPENHEVC_MAX_SUB_LAYERS - 1;
+    }
+    return tid > openhevcdec->decode_max_tid;
+  }
+
+  input_rate = (gdouble) GST_SECOND / duration;
+  target = (gdouble) fps_n / fps_d;
+  /* allow for rounding of the frame durations */
+  ratio = target >= input_rate * 0.999 ? 1. : target / input_rate;
+
+  if (openhevcdec->sps.max_sub_layers > 0)
+    max_layer = openhevcdec->sps.max_sub_layers - 1;
+  else
+    max_layer = GST_OPENHEVC_MAX_SUB_LAYERS - 1;
+  for (wanted = 0; wanted < max_layer; wanted++) {
+    if (gst_openhevcviddec_sub_layer_rate (openhevcdec, wanted,
+            input_rate) >= target * 0.999)
+      break;
+  }
+
+  if (wanted < openhevcdec->decode_max_tid) {
+    GST_DEBUG_OBJECT (openhevcdec, "only decoding sub-layers up to %u", wanted);
+    openhevcdec->decode_max_tid = wanted;
+  } else if (wanted > openhevcdec->decode_max_tid) {
+    if (irap) {
+      openhevcdec->decode_max_tid = wanted;
+    } else if (type >= NAL_TYPE_TSA_N && type <= NAL_TYPE_STSA_R
+        && tid > openhevcdec->decode_max_tid && tid <= wanted) {
+      openhevcdec->decode_max_tid = tid;
+    }
+    if (wanted == openhevcdec->decode_max_tid)
+      GST_DEBUG_OBJECT (openhevcdec, "decoding sub-layers up to %u again",
+          wanted);
+  }
+
+  /* every input picture earns its share of the target rate, every decoded
+   * one costs a full picture.  Reference pictures can't be dropped */
+  openhevcdec->output_credit =
+      CLAMP (openhevcdec->output_credit + ratio, -1., 2.);
+
+  if (tid > openhevcdec->decode_max_tid)
+    return TRUE;
+
+  if (!irap && type <= NAL_TYPE_RSV_VCL_N14 && type % 2 == 0
+      && tid == openhevcdec->decode_max_tid
+      && openhevcdec->output_credit < 1.)
+    return TRUE;
+  openhevcdec->output_credit -= 1.;
+
+  return FALSE;
+}
+
+/* Decides whether to skip decoding of an access unit because we're behind.
+ * When late, sub-layer non-reference pictures of the highest sub-layer are
+ * skipped as nothing depends on them.  When very late, everything up to the
+ * next IRAP picture is skipped.  If that is a CRA picture, its RASL pictures
+ * are skipped as well because their references are gone.  The caller keeps
+ * the parameter sets of skipped access units. */
+static gboolean
+gst_openhevcviddec_qos_skip (GstOpenHEVCVidDec * openhevcdec,
+    GstVideoCodecFrame * frame, guint type, guint tid)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (openhevcdec);
+  GstClockTimeDiff earliness;
+  GstClockTime duration;
+  gboolean irap, skip_non_ref = FALSE, skip_non_irap = FALSE;
+
+  if (tid > openhevcdec->max_temporal_id)
+    openhevcdec->max_temporal_id = tid;
+  irap = type >= NAL_TYPE_BLA_W_LP && type <= NAL_TYPE_RSV_IRAP_23;
+
+  if (openhevcdec->skip_rasl) {
+    if (type == NAL_TYPE_RASL_N || type == NAL_TYPE_RASL_R)
+      skip_non_irap = TRUE;
+    else
+      openhevcdec->skip_rasl = FALSE;
+  }
+
+  earliness = gst_video_decoder_get_max_decode_time (decoder, frame);
+
+  if (openhevcdec->irap_only) {
+    if (!irap) {
+      skip_non_irap = TRUE;
+    } else if (earliness >= 0) {
+      GST_DEBUG_OBJECT (openhevcdec, "caught up, decoding everything again");
+      openhevcdec->irap_only = FALSE;
+      openhevcdec->skip_rasl = type == NAL_TYPE_CRA;
+    }
+  } else if (earliness < 0 && !irap) {
+    duration = gst_openhevcviddec_frame_duration (openhevcdec, frame);
+    if (!GST_CLOCK_TIME_IS_VALID (duration))
+      duration = QOS_DEFAULT_FRAME_DURATION;
+
+    if (earliness < -(GstClockTimeDiff) (QOS_IRAP_ONLY_FRAMES * duration)) {
+      GST_DEBUG_OBJECT (openhevcdec, "late by %" GST_STIME_FORMAT
+          ", skipping to the next IRAP picture", GST_STIME_ARGS (-earliness));
+      openhevcdec->irap_only = TRUE;
+      skip_non_irap = TRUE;
+    } else if (type <= NAL_TYPE_RSV_VCL_N14 && type % 2 == 0
+        && tid == MIN (openhevcdec->max_temporal_id,
+            openhevcdec->decode_max_tid)) {
+      skip_non_ref = TRUE;
+    }
+  }
+
+  if (!skip_non_ref && !skip_non_irap)
+    return FALSE;
+
+  GST_LOG_OBJECT (openhevcdec, "skipping frame %u of NAL type %u, temporal "
+      "id %u, earliness %" GST_STIME_FORMAT, frame->system_frame_number,
+      type, tid, GST_STIME_ARGS (earliness));
+
+  if (skip_non_irap)
+    g_atomic_int_inc (&openhevcdec->counters.skipped_non_irap);
+  else
+    g_atomic_int_inc (&openhevcdec->counters.skipped_non_ref);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_openhevcviddec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
 {
   GstOpenHEVCVidDec *openhevcdec = (GstOpenHEVCVidDec *) decoder;
   guint8 *data;
-  gint size;
+  gsize size;
   int got_picture, got_decode;
+  guint nal_type, tid, charged = 0;
+  GstClockTime start;
   GstMapInfo minfo;
+  gboolean mapped, keyframes_only, irap = FALSE;
   GstFlowReturn ret = GST_FLOW_OK;
 
   GST_LOG_OBJECT (openhevcdec,
@@ -1121,40 +2203,86 @@ gst_openhevcviddec_handle_frame (GstVideoDecoder * decoder,
       gst_buffer_get_size (frame->input_buffer), GST_TIME_ARGS (frame->dts),
       GST_TIME_ARGS (frame->pts), GST_TIME_ARGS (frame->duration));
 
-  if (!gst_buffer_map (frame->input_buffer, &minfo, GST_MAP_READ)) {
-    GST_ELEMENT_ERROR (openhevcdec, STREAM, DECODE, ("Decoding problem"),
-        ("Failed to map buffer for reading"));
-    return GST_FLOW_ERROR;
+  mapped = FALSE;
+  if (openhevcdec->nal_length_size > 0) {
+    gboolean invalid;
+
+    if (!gst_openhevcviddec_prepare_nalff_input (openhevcdec,
+            frame->input_buffer, &data, &size, &invalid))
+      goto map_failed;
+    if (invalid)
+      goto invalid_input;
+  } else if (!gst_openhevcviddec_prepare_input (openhevcdec,
+          frame->input_buffer, &minfo, &mapped, &data, &size)) {
+    goto map_failed;
+  }
+
+  keyframes_only = gst_openhevcviddec_keyframes_only (openhevcdec);
+
+  if (_find_first_vcl (data, size, &nal_type, &tid)) {
+    irap = nal_type >= NAL_TYPE_BLA_W_LP && nal_type <= NAL_TYPE_RSV_IRAP_23;
+
+    if (irap)
+      gst_openhevcviddec_update_sps (openhevcdec, data, size);
+
+    if (keyframes_only && !irap) {
+      gst_openhevcviddec_keep_parameter_sets (openhevcdec, data, size);
+      if (mapped)
+        gst_buffer_unmap (frame->input_buffer, &minfo);
+      gst_video_decoder_release_frame (decoder, frame);
+      g_atomic_int_inc (&openhevcdec->counters.skipped_non_key);
+      return GST_FLOW_OK;
+    }
+    if (gst_openhevcviddec_temporal_skip (openhevcdec, frame, data, size,
+            nal_type, tid)) {
+      gst_openhevcviddec_keep_parameter_sets (openhevcdec, data, size);
+      if (mapped)
+        gst_buffer_unmap (frame->input_buffer, &minfo);
+      gst_video_decoder_release_frame (decoder, frame);
+      g_atomic_int_inc (&openhevcdec->counters.skipped_temporal);
+      return GST_FLOW_OK;
+    }
+    if (gst_openhevcviddec_qos_skip (openhevcdec, frame, nal_type, tid)) {
+      gst_openhevcviddec_keep_parameter_sets (openhevcdec, data, size);
+      if (mapped)
+        gst_buffer_unmap (frame->input_buffer, &minfo);
+      return gst_video_decoder_drop_frame (decoder, frame);
+    }
   }
 
   /* treat frame as void until a buffer is requested for it */
   GST_VIDEO_CODEC_FRAME_FLAG_SET (frame,
       GST_VIDEO_CODEC_FRAME_FLAG_DECODE_ONLY);
 
-  data = minfo.data;
-  size = minfo.size;
-#if 0
-  if (size > 0 && (!GST_MEMORY_IS_ZERO_PADDED (minfo.memory)
-          || (minfo.maxsize - minfo.size) < AV_INPUT_BUFFER_PADDING_SIZE)) {
-    /* add padding */
-    if (openhevcdec->padded_size < size + AV_INPUT_BUFFER_PADDING_SIZE) {
-      openhevcdec->padded_size = size + AV_INPUT_BUFFER_PADDING_SIZE;
-      openhevcdec->padded = g_realloc (openhevcdec->padded, openhevcdec->padded_size);
-      GST_LOG_OBJECT (openhevcdec, "resized padding buffer to %" G_GSIZE_FORMAT,
-          openhevcdec->padded_size);
-    }
-    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, openhevcdec,
-        "Copy input to add padding");
-    memcpy (openhevcdec->padded, data, size);
-    memset (openhevcdec->padded + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  /* OpenHEVC only passes the pts through, so give it something that
+   * identifies the frame uniquely instead, and keep the frame around until
+   * the decoder outputs it.  Frames the table has no more room for can't be
+   * in the decoder any more */
+  gst_openhevcviddec_release_ghost_frames (openhevcdec,
+      frame->system_frame_number - (GST_OPENHEVC_FRAME_TABLE_SIZE - 1));
+  {
+    GstVideoCodecFrame *evicted;
 
-    data = openhevcdec->padded;
+    evicted = gst_openhevc_frame_table_insert (&openhevcdec->pending_frames,
+        frame);
+    if (evicted) {
+      gst_video_decoder_release_frame (decoder, evicted);
+      g_atomic_int_inc (&openhevcdec->counters.ghost_released);
+    }
   }
-#endif
 
-  /* no way of associating data with the input we pass to OpenHevc so we rely
-   * on the pts */
-  got_decode = oh_decode (openhevcdec->hevc_handle, data, size, frame->pts);
+  start = GST_OPENHEVC_STATS_NOW ();
+  if (openhevcdec->in_shared_pool)
+    charged = gst_openhevc_shared_pool_enter (gst_openhevc_threads_per_call
+        (openhevcdec), g_atomic_int_get (&openhevcdec->priority));
+  got_decode = oh_decode (openhevcdec->hevc_handle, data, size,
+      frame->system_frame_number);
+  if (openhevcdec->in_shared_pool)
+    gst_openhevc_shared_pool_exit (charged);
+  GST_OPENHEVC_STATS_RECORD (openhevcdec, &openhevcdec->tracer_stats,
+      GST_OPENHEVC_STAGE_DECODE, start);
+  openhevcdec->decoded_at[frame->system_frame_number &
+      (GST_OPENHEVC_FRAME_TABLE_SIZE - 1)] = GST_OPENHEVC_STATS_NOW ();
 
   if (got_decode < 0)
     goto decode_error;
@@ -1174,18 +2302,134 @@ gst_openhevcviddec_handle_frame (GstVideoDecoder * decoder,
   } while (got_picture);
 
 done:
-  gst_buffer_unmap (frame->input_buffer, &minfo);
+  /* nothing decoded after a keyframe can be output before it, so don't wait
+   * for the reordering to release it.  Access units without a picture, e.g.
+   * only parameter sets, have nothing to release */
+  if (keyframes_only && irap && ret == GST_FLOW_OK)
+    gst_openhevcviddec_drain (decoder);
+
+  if (mapped)
+    gst_buffer_unmap (frame->input_buffer, &minfo);
   gst_video_codec_frame_unref (frame);
 
   return ret;
 
+map_failed:
+  {
+    if (mapped)
+      gst_buffer_unmap (frame->input_buffer, &minfo);
+    GST_ELEMENT_ERROR (openhevcdec, STREAM, DECODE, ("Decoding problem"),
+        ("Failed to map buffer for reading"));
+    gst_video_codec_frame_unref (frame);
+    return GST_FLOW_ERROR;
+  }
+invalid_input:
+  {
+    GST_WARNING_OBJECT (openhevcdec, "Invalid NAL unit length, dropping "
+        "access unit");
+    g_atomic_int_inc (&openhevcdec->counters.decode_errors);
+    return gst_video_decoder_drop_frame (decoder, frame);
+  }
 decode_error:
   {
     GST_WARNING_OBJECT (openhevcdec, "Failed to send data for decoding");
+    g_atomic_int_inc (&openhevcdec->counters.decode_errors);
+    openhevcdec->handle_failed = TRUE;
     goto done;
   }
 }
 
+/* the counters wrap around at 2^32 */
+static guint64
+_get_counter (gint * counter)
+{
+  return (guint) g_atomic_int_get (counter);
+}
+
+static GstStructure *
+gst_openhevcviddec_create_stats (GstOpenHEVCVidDec * openhevcdec)
+{
+  GstOpenHEVCCounters *c = &openhevcdec->counters;
+  guint64 decoded = _get_counter (&c->decoded);
+  gint64 elapsed;
+  gint n_threads, numa_node;
+  GstOpenHEVCThreadType thread_type;
+  GstStructure *stats;
+  gchar *cpus;
+
+  GST_OBJECT_LOCK (openhevcdec);
+  n_threads = openhevcdec->n_threads;
+  thread_type = openhevcdec->cur_thread_type;
+  cpus = g_strdup (openhevcdec->cur_cpus);
+  numa_node = openhevcdec->out_numa_node;
+  elapsed = g_get_monotonic_time () - openhevcdec->stats_start;
+  if (!openhevcdec->started)
+    elapsed = 0;
+  GST_OBJECT_UNLOCK (openhevcdec);
+
+  stats = gst_structure_new ("application/x-openhevcdec-stats",
+      "decoded", G_TYPE_UINT64, decoded,
+      "dropped", G_TYPE_UINT64, _get_counter (&c->dropped),
+      "skipped-non-reference", G_TYPE_UINT64,
+      _get_counter (&c->skipped_non_ref),
+      "skipped-non-irap", G_TYPE_UINT64, _get_counter (&c->skipped_non_irap),
+      "skipped-temporal", G_TYPE_UINT64, _get_counter (&c->skipped_temporal),
+      "skipped-non-keyframe", G_TYPE_UINT64,
+      _get_counter (&c->skipped_non_key),
+      "ghost-released", G_TYPE_UINT64, _get_counter (&c->ghost_released),
+      "decode-errors", G_TYPE_UINT64, _get_counter (&c->decode_errors),
+      "renegotiations", G_TYPE_UINT64, _get_counter (&c->renegotiations),
+      "n-threads", G_TYPE_INT, n_threads,
+      "thread-type", GST_TYPE_OPENHEVC_THREAD_TYPE, thread_type,
+      "cpu-affinity", G_TYPE_STRING, cpus,
+      "numa-node", G_TYPE_INT, numa_node,
+      "decode-fps", G_TYPE_DOUBLE,
+      elapsed > 0 ? decoded * (gdouble) G_USEC_PER_SEC / elapsed : 0.,
+      NULL);
+  g_free (cpus);
+
+  return stats;
+}
+
+static gboolean
+gst_openhevcviddec_post_stats (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data)
+{
+  GstOpenHEVCVidDec *openhevcdec = user_data;
+
+  gst_element_post_message (GST_ELEMENT (openhevcdec),
+      gst_message_new_element (GST_OBJECT (openhevcdec),
+          gst_openhevcviddec_create_stats (openhevcdec)));
+
+  return TRUE;
+}
+
+/* with LOCK, (re)starts posting stats when running with an interval set */
+static void
+gst_openhevcviddec_schedule_stats (GstOpenHEVCVidDec * openhevcdec)
+{
+  GstClock *clock;
+
+  if (openhevcdec->stats_id) {
+    gst_clock_id_unschedule (openhevcdec->stats_id);
+    gst_clock_id_unref (openhevcdec->stats_id);
+    openhevcdec->stats_id = NULL;
+  }
+
+  if (!openhevcdec->started || openhevcdec->stats_interval == 0)
+    return;
+
+  /* keeps going while the pipeline clock is paused */
+  clock = gst_system_clock_obtain ();
+  openhevcdec->stats_id = gst_clock_new_periodic_id (clock,
+      gst_clock_get_time (clock) + openhevcdec->stats_interval,
+      openhevcdec->stats_interval);
+  gst_clock_id_wait_async (openhevcdec->stats_id,
+      gst_openhevcviddec_post_stats, gst_object_ref (openhevcdec),
+      (GDestroyNotify) gst_object_unref);
+  gst_object_unref (clock);
+}
+
 static gboolean
 gst_openhevcviddec_start (GstVideoDecoder * decoder)
 {
@@ -1193,6 +2437,15 @@ gst_openhevcviddec_start (GstVideoDecoder * decoder)
 
   GST_OBJECT_LOCK (openhevcdec);
   gst_openhevcviddec_close (openhevcdec, FALSE);
+  memset (&openhevcdec->counters, 0, sizeof (openhevcdec->counters));
+  openhevcdec->stats_start = g_get_monotonic_time ();
+  openhevcdec->started = TRUE;
+  if (openhevcdec->shared_pool && !openhevcdec->in_shared_pool) {
+    openhevcdec->shared_threads =
+        gst_openhevc_shared_pool_join (openhevcdec->shared_pool_size);
+    openhevcdec->in_shared_pool = TRUE;
+  }
+  gst_openhevcviddec_schedule_stats (openhevcdec);
   GST_OBJECT_UNLOCK (openhevcdec);
 
   return TRUE;
@@ -1205,7 +2458,17 @@ gst_openhevcviddec_stop (GstVideoDecoder * decoder)
 
   GST_OBJECT_LOCK (openhevcdec);
   gst_openhevcviddec_close (openhevcdec, FALSE);
+  openhevcdec->started = FALSE;
+  if (openhevcdec->in_shared_pool) {
+    gst_openhevc_shared_pool_leave ();
+    openhevcdec->shared_threads = 0;
+    openhevcdec->in_shared_pool = FALSE;
+  }
+  gst_openhevcviddec_schedule_stats (openhevcdec);
   GST_OBJECT_UNLOCK (openhevcdec);
+  gst_openhevcviddec_free_copy_pool (openhevcdec);
+  gst_openhevc_frame_table_clear (&openhevcdec->pending_frames);
+  gst_openhevcviddec_free_arena (openhevcdec);
   if (openhevcdec->input_state)
     gst_video_codec_state_unref (openhevcdec->input_state);
   openhevcdec->input_state = NULL;
@@ -1236,20 +2499,72 @@ gst_openhevcviddec_flush (GstVideoDecoder * decoder)
     GST_LOG_OBJECT (decoder, "flushing buffers");
     oh_flush (openhevcdec->hevc_handle);
   }
+  gst_openhevc_frame_table_clear (&openhevcdec->pending_frames);
+  openhevcdec->irap_only = FALSE;
+  openhevcdec->skip_rasl = FALSE;
 
   return TRUE;
 }
 
+/* After a drain, all pictures of the DPB plus those still in flight in
+ * frame threads are output back to back, on top of the @min buffers
+ * downstream holds on to.  Without a limit from downstream the pool may
+ * grow to REQUIRED_POOL_MAX_BUFFERS, then max-memory caps it further */
+static void
+gst_openhevcviddec_size_pool (GstOpenHEVCVidDec * openhevcdec, guint size,
+    guint * min, guint * max)
+{
+  guint dpb_size, max_buffers;
+  guint64 max_memory;
+
+  dpb_size = openhevcdec->sps.max_dec_pic_buffering;
+  openhevcdec->pool_dpb_size = dpb_size;
+  /* unknown yet, and never more than any level allows whatever the SPS
+   * claims */
+  if (dpb_size == 0 || dpb_size > MAX_DPB_SIZE)
+    dpb_size = MAX_DPB_SIZE;
+
+  *min += dpb_size + gst_openhevc_threading_delay (openhevcdec);
+  if (*max == 0 || *max > REQUIRED_POOL_MAX_BUFFERS)
+    max_buffers = REQUIRED_POOL_MAX_BUFFERS;
+  else
+    max_buffers = *max;
+  max_buffers = MAX (max_buffers, *min);
+
+  GST_OBJECT_LOCK (openhevcdec);
+  max_memory = openhevcdec->max_memory;
+  GST_OBJECT_UNLOCK (openhevcdec);
+
+  if (max_memory > 0 && size > 0) {
+    guint64 fitting = max_memory / size;
+
+    if (fitting < *min) {
+      GST_WARNING_OBJECT (openhevcdec, "max-memory of %" G_GUINT64_FORMAT
+          " bytes only fits %" G_GUINT64_FORMAT " buffers, %u are needed",
+          max_memory, fitting, *min);
+      max_buffers = *min;
+    } else {
+      max_buffers = MIN (max_buffers, fitting);
+    }
+  }
+
+  GST_DEBUG_OBJECT (openhevcdec, "output pool of %u-%u buffers of %u bytes "
+      "for a DPB of %u pictures", *min, max_buffers, size, dpb_size);
+  *max = max_buffers;
+}
+
 static gboolean
 gst_openhevcviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
 {
+  GstOpenHEVCVidDec *openhevcdec = (GstOpenHEVCVidDec *) decoder;
   GstVideoCodecState *state;
   GstBufferPool *pool;
   guint size, min, max;
   GstStructure *config;
-  gboolean have_pool, have_videometa, have_alignment, update_pool = FALSE;
+  gboolean have_pool, have_videometa, have_alignment;
   GstAllocator *allocator = NULL;
   GstAllocationParams params = DEFAULT_ALLOC_PARAM;
+  gint numa_node;
 
   have_pool = (gst_query_get_n_allocation_pools (query) != 0);
 
@@ -1266,7 +2581,32 @@ gst_openhevcviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * quer
     gst_query_add_allocation_param (query, allocator, &params);
   }
 
+  /* only system memory is ours to place */
+  GST_OBJECT_LOCK (openhevcdec);
+  numa_node = openhevcdec->numa_node;
+  GST_OBJECT_UNLOCK (openhevcdec);
+  if (numa_node >= 0 && allocator
+      && g_strcmp0 (allocator->mem_type, GST_ALLOCATOR_SYSMEM) != 0) {
+    GST_INFO_OBJECT (openhevcdec, "not placing downstream's %s memory on "
+        "NUMA node %d", allocator->mem_type, numa_node);
+    numa_node = -1;
+  } else if (numa_node >= 0) {
+    GstAllocator *numa_allocator = gst_openhevc_numa_allocator_new (numa_node);
+
+    if (numa_allocator) {
+      if (allocator)
+        gst_object_unref (allocator);
+      allocator = numa_allocator;
+      gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+    } else {
+      numa_node = -1;
+    }
+  }
+
   gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  if (size == 0)
+    size = GST_VIDEO_INFO_SIZE (&state->info);
+  gst_openhevcviddec_size_pool (openhevcdec, size, &min, &max);
 
   config = gst_buffer_pool_get_config (pool);
   gst_buffer_pool_config_set_params (config, state->caps, size, min, max);
@@ -1299,15 +2639,18 @@ gst_openhevcviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * quer
       pool = gst_video_buffer_pool_new ();
       config = gst_buffer_pool_get_config (pool);
       gst_buffer_pool_config_set_params (config, state->caps, size, min, max);
-      gst_buffer_pool_config_set_allocator (config, NULL, &params);
+      gst_buffer_pool_config_set_allocator (config,
+          numa_node >= 0 ? allocator : NULL, &params);
       gst_buffer_pool_set_config (pool, config);
-      update_pool = TRUE;
     }
   }
 
-  /* and store */
-  if (update_pool)
-    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  /* and store, the sizing changed at least */
+  gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+
+  GST_OBJECT_LOCK (openhevcdec);
+  openhevcdec->out_numa_node = numa_node;
+  GST_OBJECT_UNLOCK (openhevcdec);
 
   gst_object_unref (pool);
   if (allocator)
@@ -1326,7 +2669,7 @@ gst_openhevcviddec_propose_allocation (GstVideoDecoder * decoder,
   gst_allocation_params_init (&params);
   params.flags = GST_MEMORY_FLAG_ZERO_PADDED;
   params.align = DEFAULT_STRIDE_ALIGN;
-//  params.padding = AV_INPUT_BUFFER_PADDING_SIZE;
+  params.padding = INPUT_PADDING_SIZE;
   /* we would like to have some padding so that we don't have to
    * memcpy. We don't suggest an allocator. */
   gst_query_add_allocation_param (query, NULL, &params);
@@ -1345,12 +2688,83 @@ gst_openhevcviddec_set_property (GObject * object,
     case PROP_MAX_THREADS:
       openhevcdec->max_threads = g_value_get_int (value);
       break;
+    case PROP_THREAD_TYPE:
+      openhevcdec->thread_type = g_value_get_enum (value);
+      break;
+    case PROP_LOW_LATENCY:
+      openhevcdec->low_latency = g_value_get_boolean (value);
+      break;
+    case PROP_REUSE_HANDLES:
+      openhevcdec->reuse_handles = g_value_get_boolean (value);
+      break;
+    case PROP_SHARED_POOL:
+      openhevcdec->shared_pool = g_value_get_boolean (value);
+      break;
+    case PROP_SHARED_POOL_SIZE:
+      openhevcdec->shared_pool_size = g_value_get_uint (value);
+      break;
+    case PROP_PRIORITY:
+      g_atomic_int_set (&openhevcdec->priority, g_value_get_int (value));
+      break;
+    case PROP_CPU_AFFINITY:{
+      const gchar *cpu_list = g_value_get_string (value);
+      gchar *cpus = gst_openhevc_placement_normalize_cpus (cpu_list);
+
+      if (cpu_list && *cpu_list && !cpus) {
+        GST_WARNING_OBJECT (openhevcdec, "ignoring invalid CPU list \"%s\"",
+            cpu_list);
+        break;
+      }
+      GST_OBJECT_LOCK (openhevcdec);
+      g_free (openhevcdec->cpu_affinity);
+      openhevcdec->cpu_affinity = cpus;
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
+    }
+    case PROP_NUMA_NODE:
+      GST_OBJECT_LOCK (openhevcdec);
+      openhevcdec->numa_node = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
     case PROP_TEMPORAL_LAYER_ID:
       openhevcdec->temporal_layer_id = g_value_get_int (value);
       break;
     case PROP_QUALITY_LAYER_ID:
       openhevcdec->quality_layer_id = g_value_get_int (value);
       break;
+    case PROP_PARALLEL_COPY_THRESHOLD:
+      openhevcdec->parallel_copy_threshold = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_MEMORY:
+      GST_OBJECT_LOCK (openhevcdec);
+      openhevcdec->max_memory = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      gst_pad_mark_reconfigure (GST_VIDEO_DECODER_SRC_PAD (openhevcdec));
+      break;
+    case PROP_OUTPUT_SCALE:
+      openhevcdec->output_scale = g_value_get_enum (value);
+      break;
+    case PROP_OUTPUT_DEPTH:
+      openhevcdec->output_depth = g_value_get_enum (value);
+      break;
+    case PROP_DITHER:
+      openhevcdec->dither = g_value_get_boolean (value);
+      break;
+    case PROP_TARGET_FRAMERATE:
+      GST_OBJECT_LOCK (openhevcdec);
+      openhevcdec->target_fps_n = gst_value_get_fraction_numerator (value);
+      openhevcdec->target_fps_d = gst_value_get_fraction_denominator (value);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
+    case PROP_KEYFRAMES_ONLY:
+      openhevcdec->keyframes_only = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (openhevcdec);
+      openhevcdec->stats_interval = g_value_get_uint64 (value);
+      gst_openhevcviddec_schedule_stats (openhevcdec);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1367,12 +2781,82 @@ gst_openhevcviddec_get_property (GObject * object,
     case PROP_MAX_THREADS:
       g_value_set_int (value, openhevcdec->max_threads);
       break;
+    case PROP_THREAD_TYPE:
+      g_value_set_enum (value, openhevcdec->thread_type);
+      break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, openhevcdec->low_latency);
+      break;
+    case PROP_REUSE_HANDLES:
+      g_value_set_boolean (value, openhevcdec->reuse_handles);
+      break;
+    case PROP_SHARED_POOL:
+      g_value_set_boolean (value, openhevcdec->shared_pool);
+      break;
+    case PROP_SHARED_POOL_SIZE:
+      g_value_set_uint (value, openhevcdec->shared_pool_size);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_int (value, g_atomic_int_get (&openhevcdec->priority));
+      break;
+    case PROP_CPU_AFFINITY:
+      GST_OBJECT_LOCK (openhevcdec);
+      g_value_set_string (value, openhevcdec->cpu_affinity);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
+    case PROP_NUMA_NODE:
+      GST_OBJECT_LOCK (openhevcdec);
+      g_value_set_int (value, openhevcdec->numa_node);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
     case PROP_TEMPORAL_LAYER_ID:
       g_value_set_int (value, openhevcdec->temporal_layer_id);
       break;
     case PROP_QUALITY_LAYER_ID:
       g_value_set_int (value, openhevcdec->quality_layer_id);
       break;
+    case PROP_PARALLEL_COPY_THRESHOLD:
+      g_value_set_uint64 (value, openhevcdec->parallel_copy_threshold);
+      break;
+    case PROP_MAX_MEMORY:
+      GST_OBJECT_LOCK (openhevcdec);
+      g_value_set_uint64 (value, openhevcdec->max_memory);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
+    case PROP_OUTPUT_SCALE:
+      g_value_set_enum (value, openhevcdec->output_scale);
+      break;
+    case PROP_OUTPUT_DEPTH:
+      g_value_set_enum (value, openhevcdec->output_depth);
+      break;
+    case PROP_DITHER:
+      g_value_set_boolean (value, openhevcdec->dither);
+      break;
+    case PROP_TARGET_FRAMERATE:
+      GST_OBJECT_LOCK (openhevcdec);
+      gst_value_set_fraction (value, openhevcdec->target_fps_n,
+          openhevcdec->target_fps_d);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
+    case PROP_KEYFRAMES_ONLY:
+      g_value_set_boolean (value, openhevcdec->keyframes_only);
+      break;
+    case PROP_SKIPPED_NON_REFERENCE:
+      g_value_set_uint64 (value,
+          _get_counter (&openhevcdec->counters.skipped_non_ref));
+      break;
+    case PROP_SKIPPED_NON_IRAP:
+      g_value_set_uint64 (value,
+          _get_counter (&openhevcdec->counters.skipped_non_irap));
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_openhevcviddec_create_stats (openhevcdec));
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (openhevcdec);
+      g_value_set_uint64 (value, openhevcdec->stats_interval);
+      GST_OBJECT_UNLOCK (openhevcdec);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -23,10 +23,56 @@
 #include <gst/video/video.h>
 #include <libopenhevc/openhevc.h>
 
+#include "gstopenhevcframetable.h"
+#include "gstopenhevcsps.h"
+#include "gstopenhevcstats.h"
+
+/* HEVC streams have at most this many temporal sub-layers */
+#define GST_OPENHEVC_MAX_SUB_LAYERS 7
+
 G_BEGIN_DECLS
 
+/* frame counters for the stats property, updated atomically */
+typedef struct
+{
+  gint decoded;
+  gint dropped;
+  gint skipped_non_ref;
+  gint skipped_non_irap;
+  gint skipped_temporal;
+  gint skipped_non_key;
+  gint ghost_released;
+  gint decode_errors;
+  gint renegotiations;
+} GstOpenHEVCCounters;
+
 GType gst_openhevcviddec_get_type (void);
 
+/* values match the thread_type argument of oh_init() */
+typedef enum
+{
+  GST_OPENHEVC_THREAD_AUTO = 0,
+  GST_OPENHEVC_THREAD_FRAME = 1,
+  GST_OPENHEVC_THREAD_SLICE = 2,
+  GST_OPENHEVC_THREAD_FRAME_SLICE = 4,
+} GstOpenHEVCThreadType;
+
+/* values are the divisor applied to both dimensions */
+typedef enum
+{
+  GST_OPENHEVC_OUTPUT_SCALE_NONE = 1,
+  GST_OPENHEVC_OUTPUT_SCALE_HALF = 2,
+  GST_OPENHEVC_OUTPUT_SCALE_QUARTER = 4,
+  GST_OPENHEVC_OUTPUT_SCALE_EIGHTH = 8,
+} GstOpenHEVCOutputScale;
+
+/* values are the bit depth, 0 for that of the stream */
+typedef enum
+{
+  GST_OPENHEVC_OUTPUT_DEPTH_NATIVE = 0,
+  GST_OPENHEVC_OUTPUT_DEPTH_8 = 8,
+} GstOpenHEVCOutputDepth;
+
 typedef struct _GstOpenHEVCVidDec GstOpenHEVCVidDec;
 struct _GstOpenHEVCVidDec
 {
@@ -34,6 +80,8 @@ struct _GstOpenHEVCVidDec
 
   GstVideoCodecState *input_state;
   GstVideoCodecState *output_state;
+  /* negotiated format, might differ from what the decoder outputs */
+  GstVideoFormat output_format;
 
   /* decoding */
   OHHandle hevc_handle;
@@ -43,6 +91,9 @@ struct _GstOpenHEVCVidDec
   OHFrameInfo frame_info;
   OHFrame frame;
 
+  /* frames passed to oh_decode() that weren't output yet */
+  GstOpenHEVCFrameTable pending_frames;
+
   /* current context */
   gint ctx_ticks;
   gint ctx_time_d;
@@ -50,15 +101,99 @@ struct _GstOpenHEVCVidDec
   GstBuffer *palette;
 
   int max_threads;
+  GstOpenHEVCThreadType thread_type;
+  gboolean low_latency;
+  gboolean reuse_handles;
+  /* shared-pool, whether we joined it in start() and our share of it */
+  gboolean shared_pool;
+  guint shared_pool_size;
+  gboolean in_shared_pool;
+  guint shared_threads;
+  gint priority;
+  /* cpu-affinity and numa-node, protected by the object lock */
+  gchar *cpu_affinity;
+  gint numa_node;
+  /* configuration of the currently opened handle */
+  int n_threads;
+  GstOpenHEVCThreadType cur_thread_type;
+  /* normalized CPUs its threads are bound to, NULL if unrestricted */
+  gchar *cur_cpus;
+  /* whether it ran into a decoding error */
+  gboolean handle_failed;
+  int cur_temporal_layer_id;
+  int cur_quality_layer_id;
   int temporal_layer_id;
   int quality_layer_id;
 
   unsigned char *extradata;
 
+  /* input arena for adding padding, padded is padded_mem aligned */
   unsigned char *padded;
   gsize padded_size;
+  gpointer padded_mem;
+
+  /* hvc1/hev1 input, 0 for byte-stream.  The parameter sets from the
+   * codec_data are sent in front of the next access unit */
+  guint nal_length_size;
+  GByteArray *parameter_sets;
+  gboolean parameter_sets_pending;
+
+  /* last SPS seen in the stream, max_sub_layers is 0 until then */
+  GstOpenHEVCSPS sps;
+  /* last latency reported */
+  GstClockTime latency_min;
+  GstClockTime latency_max;
+
+  /* only decode IRAP access units */
+  gboolean keyframes_only;
+
+  /* QoS state */
+  guint max_temporal_id;
+  gboolean irap_only;
+  gboolean skip_rasl;
+
+  /* target-framerate, protected by the object lock */
+  gint target_fps_n;
+  gint target_fps_d;
+  /* sub-layer selection for it */
+  guint sub_layer_counts[GST_OPENHEVC_MAX_SUB_LAYERS];
+  guint sub_layer_total;
+  guint decode_max_tid;
+  gdouble output_credit;
 
   GstCaps *last_caps;
+
+  /* node the output pool allocates on, -1 if not placed */
+  gint out_numa_node;
+
+  /* output-scale, and the one the current caps were negotiated with */
+  GstOpenHEVCOutputScale output_scale;
+  guint cur_output_scale;
+  /* output-depth, and the one the current caps were negotiated with */
+  GstOpenHEVCOutputDepth output_depth;
+  GstOpenHEVCOutputDepth cur_output_depth;
+  gboolean dither;
+
+  /* max-memory, protected by the object lock */
+  guint64 max_memory;
+  /* DPB size the output pool was sized for */
+  guint pool_dpb_size;
+
+  /* threads for copying out large frames */
+  guint64 parallel_copy_threshold;
+  GstTaskPool *copy_pool;
+
+  GstOpenHEVCCounters counters;
+  /* monotonic time of start() */
+  gint64 stats_start;
+  /* periodic stats messages, protected by the object lock */
+  GstClockTime stats_interval;
+  GstClockID stats_id;
+  gboolean started;
+
+  /* openhevcstats tracer, decoded_at is indexed like pending_frames */
+  GstOpenHEVCStats *tracer_stats;
+  GstClockTime decoded_at[GST_OPENHEVC_FRAME_TABLE_SIZE];
 };
 
 typedef struct _GstOpenHEVCVidDecClass GstOpenHEVCVidDecClass;
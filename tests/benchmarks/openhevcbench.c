@@ -0,0 +1,364 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/* Microbenchmarks for the per-frame hot paths of openhevcdec that can run
+ * without a bitstream: copying decoded pictures out, matching output
+ * pictures to their frames, and building the output caps.  Results are
+ * printed as JSON on stdout. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstopenhevccopy.h"
+#include "gstopenhevcframetable.h"
+#include "gstopenhevcoutput.h"
+
+GST_DEBUG_CATEGORY (openhevc_debug);
+
+/* distance of output from decode order, like a hierarchical GOP of 8 */
+#define REORDER_DEPTH 8
+
+typedef struct
+{
+  const gchar *name;
+  gint width;
+  gint height;
+} Resolution;
+
+static const Resolution resolutions[] = {
+  {"720p", 1280, 720},
+  {"1080p", 1920, 1080},
+  {"2160p", 3840, 2160},
+  {"4320p", 7680, 4320},
+};
+
+typedef enum
+{
+  STRIDE_TIGHT,
+  STRIDE_ALIGNED,
+  STRIDE_ODD,
+} StrideMode;
+
+static const gchar *stride_names[] = { "tight", "aligned", "odd" };
+
+static gint min_time_ms = 200;
+static gboolean first_result = TRUE;
+
+static gsize
+make_stride (gsize row_bytes, StrideMode mode)
+{
+  switch (mode) {
+    case STRIDE_ALIGNED:
+      /* what libavcodec style frame pools use */
+      return GST_ROUND_UP_64 (row_bytes) + 64;
+    case STRIDE_ODD:
+      return row_bytes + 24;
+    default:
+      return row_bytes;
+  }
+}
+
+static void
+print_result (const gchar * benchmark, const gchar * format,
+    const Resolution * res, gint depth, const gchar * stride, guint64 iters,
+    GstClockTime elapsed, gsize bytes_per_frame)
+{
+  gdouble ns = (gdouble) elapsed / iters;
+
+  g_print ("%s    {\"benchmark\": \"%s\", \"format\": \"%s\", "
+      "\"resolution\": \"%s\", \"width\": %d, \"height\": %d, "
+      "\"depth\": %d, \"stride\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+      ", \"ns_per_frame\": %.1f", first_result ? "" : ",\n", benchmark,
+      format, res ? res->name : "", res ? res->width : 0,
+      res ? res->height : 0, depth, stride, iters, ns);
+  if (bytes_per_frame)
+    g_print (", \"bytes_per_frame\": %" G_GSIZE_FORMAT ", \"gb_per_s\": %.3f",
+        bytes_per_frame, bytes_per_frame / ns);
+  g_print ("}");
+
+  first_result = FALSE;
+}
+
+/* what copy_frame_to_codec_frame() does per frame once the output buffer
+ * is allocated: map it, build the per plane jobs and run them, in bands on
+ * a task pool with @parallel */
+static void
+bench_output (const Resolution * res, GstVideoFormat native,
+    GstVideoFormat format, guint scale, gboolean dither,
+    StrideMode stride_mode, gboolean parallel)
+{
+  GstVideoInfo src_info, info;
+  GstOpenHEVCCopyJob jobs[GST_VIDEO_MAX_PLANES];
+  guint8 *src[3] = { NULL, };
+  gsize src_stride[3] = { 0, };
+  GstTaskPool *pool = NULL;
+  guint n_bands = 1;
+  GstBuffer *buffer;
+  GstClockTime start, elapsed;
+  guint64 iters = 0;
+  const gchar *op;
+  gchar *name;
+  guint i;
+
+  gst_video_info_set_format (&src_info, native, res->width, res->height);
+  gst_video_info_set_format (&info, format, (res->width + scale - 1) / scale,
+      (res->height + scale - 1) / scale);
+
+  for (i = 0; i < GST_VIDEO_INFO_N_COMPONENTS (&src_info); i++) {
+    gsize h = GST_VIDEO_INFO_COMP_HEIGHT (&src_info, i);
+
+    src_stride[i] = make_stride (GST_VIDEO_INFO_COMP_WIDTH (&src_info, i) *
+        GST_VIDEO_INFO_COMP_PSTRIDE (&src_info, i), stride_mode);
+    src[i] = g_malloc (src_stride[i] * h);
+    /* valid 8 and 10 bit samples alike */
+    memset (src[i], 0x01 + i, src_stride[i] * h);
+  }
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&info), NULL);
+
+  if (parallel) {
+    pool = gst_task_pool_new ();
+    gst_task_pool_prepare (pool, NULL);
+    n_bands = MIN (g_get_num_processors (), GST_OPENHEVC_OUTPUT_MAX_BANDS);
+  }
+
+  start = gst_util_get_timestamp ();
+  do {
+    GstVideoFrame frame;
+    guint n_jobs;
+
+    if (!gst_video_frame_map (&frame, &info, buffer, GST_MAP_WRITE))
+      g_error ("failed to map output frame");
+    n_jobs = gst_openhevc_output_build_jobs (jobs, &frame, &src_info,
+        (const guint8 * const *) src, src_stride, scale, dither);
+    gst_openhevc_output_run_jobs (jobs, n_jobs, pool, n_bands);
+    gst_video_frame_unmap (&frame);
+
+    iters++;
+    elapsed = gst_util_get_timestamp () - start;
+  } while (elapsed < min_time_ms * GST_MSECOND || iters < 3);
+
+  if (scale > 1)
+    op = "downscale";
+  else if (GST_VIDEO_INFO_COMP_DEPTH (&src_info, 0) !=
+      GST_VIDEO_INFO_COMP_DEPTH (&info, 0))
+    op = dither ? "reduce-dither" : "reduce";
+  else
+    op = "copy";
+  if (scale > 1)
+    name = g_strdup_printf ("%s-1/%u%s", op, scale,
+        parallel ? "-parallel" : "");
+  else
+    name = g_strdup_printf ("%s%s", op, parallel ? "-parallel" : "");
+
+  /* throughput is over the decoded frame that is read */
+  print_result (name, gst_video_format_to_string (format), res,
+      GST_VIDEO_INFO_COMP_DEPTH (&src_info, 0), stride_names[stride_mode],
+      iters, elapsed, GST_VIDEO_INFO_SIZE (&src_info));
+  g_free (name);
+
+  if (pool) {
+    gst_task_pool_cleanup (pool);
+    gst_object_unref (pool);
+  }
+  gst_buffer_unref (buffer);
+  for (i = 0; i < 3; i++)
+    g_free (src[i]);
+}
+
+/* insert in decode order, take in output order and release what's left
+ * behind, like handle_frame() and video_frame() do */
+static void
+bench_frame_table (void)
+{
+  GstOpenHEVCFrameTable table;
+  GstVideoCodecFrame *frames[4 * REORDER_DEPTH];
+  GstClockTime start, elapsed;
+  guint64 iters = 0;
+  guint32 sfn = 0;
+  guint i;
+
+  /* there's no public constructor, we hold a reference to all of them for
+   * the whole run so they never get freed by the table */
+  for (i = 0; i < G_N_ELEMENTS (frames); i++) {
+    frames[i] = g_slice_new0 (GstVideoCodecFrame);
+    frames[i]->ref_count = 1;
+  }
+
+  gst_openhevc_frame_table_init (&table);
+
+  start = gst_util_get_timestamp ();
+  do {
+    for (i = 0; i < 1024; i++, sfn++) {
+      GstVideoCodecFrame *frame = frames[sfn % G_N_ELEMENTS (frames)];
+      GstVideoCodecFrame *out;
+      guint32 out_sfn;
+
+      frame->system_frame_number = sfn;
+      if ((out = gst_openhevc_frame_table_insert (&table, frame)))
+        gst_video_codec_frame_unref (out);
+
+      if (sfn < REORDER_DEPTH)
+        continue;
+
+      /* output the previous GOP back to front */
+      out_sfn = sfn - 2 * (sfn % REORDER_DEPTH);
+      if ((out = gst_openhevc_frame_table_take (&table, out_sfn)))
+        gst_video_codec_frame_unref (out);
+
+      while ((out = gst_openhevc_frame_table_pop_older (&table,
+                  sfn - 2 * REORDER_DEPTH)))
+        gst_video_codec_frame_unref (out);
+    }
+    iters += 1024;
+    elapsed = gst_util_get_timestamp () - start;
+  } while (elapsed < min_time_ms * GST_MSECOND);
+
+  print_result ("frame-table", "", NULL, 0, "", iters, elapsed, 0);
+
+  gst_openhevc_frame_table_clear (&table);
+  for (i = 0; i < G_N_ELEMENTS (frames); i++)
+    g_slice_free (GstVideoCodecFrame, frames[i]);
+}
+
+/* the format work of negotiate(): choosing the output format against what
+ * downstream allows with output-depth=@depth, and the output caps.  The
+ * base class part needs a pipeline and isn't included */
+static void
+bench_output_caps (const Resolution * res, GstVideoFormat native, guint depth)
+{
+  GstCaps *allowed;
+  GstClockTime start, elapsed;
+  GstVideoFormat format = GST_VIDEO_FORMAT_UNKNOWN;
+  guint64 iters = 0;
+
+  allowed = gst_caps_from_string ("video/x-raw, format=(string){ NV12, I420 }"
+      "; video/x-raw, format=(string)I420_10LE");
+
+  start = gst_util_get_timestamp ();
+  do {
+    GstVideoInfo info;
+    GstCaps *caps;
+
+    format = gst_openhevc_output_choose_format (native, depth, allowed);
+    gst_video_info_set_format (&info, format, res->width, res->height);
+    GST_VIDEO_INFO_FPS_N (&info) = 50;
+    GST_VIDEO_INFO_FPS_D (&info) = 1;
+    caps = gst_video_info_to_caps (&info);
+    if (!gst_caps_can_intersect (caps, allowed))
+      g_error ("no intersection");
+    gst_caps_unref (caps);
+
+    iters++;
+    elapsed = gst_util_get_timestamp () - start;
+  } while (elapsed < min_time_ms * GST_MSECOND);
+
+  print_result (depth ? "output-caps-reduced" : "output-caps",
+      gst_video_format_to_string (format), res,
+      GST_VIDEO_FORMAT_INFO_DEPTH (gst_video_format_get_info (native), 0), "",
+      iters, elapsed, 0);
+
+  gst_caps_unref (allowed);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionEntry options[] = {
+    {"min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+        "Minimum time to run each case for in milliseconds", "MS"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  guint r, s, scale;
+
+  ctx = g_option_context_new ("- openhevcdec microbenchmarks");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  GST_DEBUG_CATEGORY_INIT (openhevc_debug, "openhevc", 0, "openhevc bench");
+
+  g_print ("{\n  \"copy-implementation\": \"%s\",\n  \"results\": [\n",
+      gst_openhevc_copy_get_impl_name ());
+
+  for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+    for (s = STRIDE_TIGHT; s <= STRIDE_ODD; s++) {
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420,
+          GST_VIDEO_FORMAT_I420, 1, FALSE, s, FALSE);
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420,
+          GST_VIDEO_FORMAT_NV12, 1, FALSE, s, FALSE);
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+          GST_VIDEO_FORMAT_I420_10LE, 1, FALSE, s, FALSE);
+    }
+  }
+
+  /* the banding parallel-copy-threshold enables */
+  for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+    bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420,
+        GST_VIDEO_FORMAT_I420, 1, FALSE, STRIDE_ALIGNED, TRUE);
+    bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+        GST_VIDEO_FORMAT_I420_10LE, 1, FALSE, STRIDE_ALIGNED, TRUE);
+  }
+
+  for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+    for (scale = 2; scale <= 8; scale *= 2) {
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420,
+          GST_VIDEO_FORMAT_I420, scale, FALSE, STRIDE_ALIGNED, FALSE);
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420,
+          GST_VIDEO_FORMAT_NV12, scale, FALSE, STRIDE_ALIGNED, FALSE);
+      bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+          GST_VIDEO_FORMAT_I420_10LE, scale, FALSE, STRIDE_ALIGNED, FALSE);
+    }
+  }
+
+  for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+    bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+        GST_VIDEO_FORMAT_I420, 1, FALSE, STRIDE_ALIGNED, FALSE);
+    bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+        GST_VIDEO_FORMAT_I420, 1, TRUE, STRIDE_ALIGNED, FALSE);
+    bench_output (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE,
+        GST_VIDEO_FORMAT_NV12, 1, FALSE, STRIDE_ALIGNED, FALSE);
+  }
+
+  bench_frame_table ();
+
+  for (r = 0; r < G_N_ELEMENTS (resolutions); r++) {
+    bench_output_caps (&resolutions[r], GST_VIDEO_FORMAT_I420, 0);
+    bench_output_caps (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE, 0);
+    bench_output_caps (&resolutions[r], GST_VIDEO_FORMAT_I420_10LE, 8);
+  }
+
+  g_print ("\n  ]\n}\n");
+
+  return 0;
+}
@@ -0,0 +1,556 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the C plane kernels against values computed independently here,
+ * and that every SIMD implementation the CPU supports gives exactly the same
+ * output as the C one, on odd widths, odd strides and unaligned planes so
+ * that the tails and edges get covered. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "gstopenhevccopy.h"
+
+/* fill value for the destination, padding must still have it afterwards */
+#define DST_FILL 0xa5
+
+static const gsize widths[] = {
+  1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 129, 255, 257, 1025
+};
+
+/* samples added to the row size for the stride, 0 makes planes
+ * contiguous */
+static const gsize paddings[] = { 0, 5, 67 };
+
+static const guint rows_list[] = { 1, 7, 9 };
+
+typedef struct
+{
+  const guint8 *src_a;
+  const guint8 *src_b;
+  gsize src_stride;
+  gsize dst_stride;
+  gsize width;
+  guint rows;
+  guint pstride;
+  guint scale;
+  guint shift;
+  gboolean dither;
+  guint first_row;
+  gboolean non_temporal;
+  /* use the source stride for the destination too */
+  gboolean same_stride;
+} Params;
+
+typedef void (*RunFunc) (const Params * p, guint8 * dst);
+/* writes the expected destination samples */
+typedef void (*ExpectFunc) (const Params * p, guint8 * dst);
+
+/* the documented ordered dither thresholds, in sixteenths */
+static const guint8 dither_matrix[4][4] = {
+  {0, 8, 2, 10},
+  {12, 4, 14, 6},
+  {3, 11, 1, 9},
+  {15, 7, 13, 5},
+};
+
+/* a plane of @size bytes starting at @offset into its allocation, with
+ * random 8 bit or 10 bit samples that include the extremes */
+static guint8 *
+make_plane (gsize size, guint offset, guint pstride, guint8 ** mem)
+{
+  guint8 *data;
+  gsize i;
+
+  *mem = g_malloc (size + offset);
+  data = *mem + offset;
+
+  if (pstride == 1) {
+    for (i = 0; i < size; i++)
+      data[i] = g_test_rand_int_range (0, 256);
+    data[0] = 0xff;
+  } else {
+    guint16 v;
+
+    for (i = 0; i + 1 < size; i += 2) {
+      v = g_test_rand_int_range (0, 1024);
+      if (i % 22 == 0)
+        v = 1023;
+      memcpy (data + i, &v, 2);
+    }
+  }
+
+  return data;
+}
+
+static void
+fail_at (const gchar * what, const gchar * name, const gchar * against,
+    const Params * p, const guint8 * out, const guint8 * ref, gsize b)
+{
+  g_error ("%s: %s differs from %s at byte %" G_GSIZE_FORMAT " (row %"
+      G_GSIZE_FORMAT ") with width %" G_GSIZE_FORMAT " rows %u src stride %"
+      G_GSIZE_FORMAT " dst stride %" G_GSIZE_FORMAT " pstride %u scale %u "
+      "shift %u dither %d first row %u non-temporal %d: %u != %u", what,
+      name, against, b, b / p->dst_stride, p->width, p->rows, p->src_stride,
+      p->dst_stride, p->pstride, p->scale, p->shift, p->dither, p->first_row,
+      p->non_temporal, out[b], ref[b]);
+}
+
+static void
+check_all_impls (const gchar * what, RunFunc run, ExpectFunc expect,
+    const Params * p, guint rows)
+{
+  gsize dst_size = p->dst_stride * rows;
+  guint8 *ref, *out;
+  gsize b;
+  guint i;
+
+  ref = g_malloc (dst_size);
+  out = g_malloc (dst_size);
+
+  g_assert_true (gst_openhevc_copy_set_impl ("c"));
+  memset (ref, DST_FILL, dst_size);
+  run (p, ref);
+
+  /* the C kernel against the expected values, including untouched
+   * padding */
+  memset (out, DST_FILL, dst_size);
+  expect (p, out);
+  if (memcmp (ref, out, dst_size) != 0) {
+    for (b = 0; ref[b] == out[b]; b++);
+    fail_at (what, "c", "expected", p, ref, out, b);
+  }
+
+  for (i = 0; gst_openhevc_copy_impl_names[i]; i++) {
+    const gchar *name = gst_openhevc_copy_impl_names[i];
+
+    if (strcmp (name, "c") == 0 || !gst_openhevc_copy_set_impl (name))
+      continue;
+
+    memset (out, DST_FILL, dst_size);
+    run (p, out);
+
+    if (memcmp (ref, out, dst_size) == 0)
+      continue;
+
+    for (b = 0; ref[b] == out[b]; b++);
+    fail_at (what, name, "c", p, out, ref, b);
+  }
+
+  g_free (out);
+  g_free (ref);
+}
+
+/* runs @run for all widths, paddings and row counts.  @dst_row_bytes gives
+ * the destination row size for a source width */
+static void
+check_plane_kernel (const gchar * what, RunFunc run, ExpectFunc expect,
+    Params * p, gboolean two_planes,
+    gsize (*dst_row_bytes) (const Params * p),
+    guint (*dst_rows) (const Params * p))
+{
+  /* 16 bit samples in the destination */
+  guint dst_pstride = p->pstride == 2 && p->shift == 0 ? 2 : 1;
+  guint w, s, r, offset;
+
+  for (w = 0; w < G_N_ELEMENTS (widths); w++) {
+    for (s = 0; s < G_N_ELEMENTS (paddings); s++) {
+      for (r = 0; r < G_N_ELEMENTS (rows_list); r++) {
+        guint8 *mem_a, *mem_b = NULL;
+        gsize src_size;
+
+        p->width = widths[w];
+        p->rows = rows_list[r];
+        p->src_stride = (p->width + paddings[s]) * p->pstride;
+        if (p->same_stride)
+          p->dst_stride = p->src_stride;
+        else
+          p->dst_stride = dst_row_bytes (p) +
+              paddings[G_N_ELEMENTS (paddings) - 1 - s] * dst_pstride;
+        src_size = p->src_stride * (p->rows - 1) + p->width * p->pstride;
+        /* unaligned, but keep 16 bit samples at even addresses */
+        offset = p->pstride == 1 ? 1 + s : 2 * s;
+
+        p->src_a = make_plane (src_size, offset, p->pstride, &mem_a);
+        if (two_planes)
+          p->src_b = make_plane (src_size, offset + p->pstride, p->pstride,
+              &mem_b);
+
+        check_all_impls (what, run, expect, p, dst_rows (p));
+
+        g_free (mem_b);
+        g_free (mem_a);
+      }
+    }
+  }
+}
+
+static gsize
+same_row_bytes (const Params * p)
+{
+  return p->width * p->pstride;
+}
+
+static gsize
+reduced_row_bytes (const Params * p)
+{
+  return p->width;
+}
+
+static gsize
+interleaved_row_bytes (const Params * p)
+{
+  return 2 * p->width;
+}
+
+static gsize
+downscaled_row_bytes (const Params * p)
+{
+  return (p->width + p->scale - 1) / p->scale * (p->shift ? 1 : p->pstride);
+}
+
+static gsize
+downscaled_interleaved_row_bytes (const Params * p)
+{
+  return 2 * ((p->width + p->scale - 1) / p->scale);
+}
+
+static guint
+same_rows (const Params * p)
+{
+  return p->rows;
+}
+
+static guint
+downscaled_rows (const Params * p)
+{
+  return (p->rows + p->scale - 1) / p->scale;
+}
+
+static void
+run_copy (const Params * p, guint8 * dst)
+{
+  gst_openhevc_copy_plane (dst, p->dst_stride, p->src_a, p->src_stride,
+      p->width, p->rows, p->non_temporal);
+}
+
+static void
+run_interleave (const Params * p, guint8 * dst)
+{
+  gst_openhevc_interleave_plane (dst, p->dst_stride, p->src_a, p->src_stride,
+      p->src_b, p->src_stride, p->width, p->rows);
+}
+
+/* exactly as much scratch memory as asked for, so that using more of it
+ * gets caught by valgrind or ASan */
+static guint8 *
+alloc_scratch (const Params * p)
+{
+  return g_malloc (gst_openhevc_copy_scratch_size (p->width));
+}
+
+static void
+run_downscale (const Params * p, guint8 * dst)
+{
+  guint8 *scratch = alloc_scratch (p);
+
+  gst_openhevc_downscale_plane (dst, p->dst_stride, p->src_a, p->src_stride,
+      p->width, p->rows, p->pstride, p->scale, p->shift, scratch);
+  g_free (scratch);
+}
+
+static void
+run_downscale_interleave (const Params * p, guint8 * dst)
+{
+  guint8 *scratch = alloc_scratch (p);
+
+  gst_openhevc_downscale_interleave_plane (dst, p->dst_stride, p->src_a,
+      p->src_stride, p->src_b, p->src_stride, p->width, p->rows, p->pstride,
+      p->scale, p->shift, scratch);
+  g_free (scratch);
+}
+
+static void
+run_reduce (const Params * p, guint8 * dst)
+{
+  gst_openhevc_reduce_plane (dst, p->dst_stride, p->src_a, p->src_stride,
+      p->width, p->rows, p->shift, p->dither, p->first_row);
+}
+
+static void
+run_reduce_interleave (const Params * p, guint8 * dst)
+{
+  guint8 *scratch = alloc_scratch (p);
+
+  gst_openhevc_reduce_interleave_plane (dst, p->dst_stride, p->src_a,
+      p->src_stride, p->src_b, p->src_stride, p->width, p->rows, p->shift,
+      p->dither, p->first_row, scratch);
+  g_free (scratch);
+}
+
+static guint
+src_sample (const guint8 * plane, const Params * p, gsize x, gsize y)
+{
+  const guint8 *row = plane + y * p->src_stride;
+
+  if (p->pstride == 1)
+    return row[x];
+
+  return ((const guint16 *) row)[x];
+}
+
+static void
+put_sample (guint8 * dst, const Params * p, gboolean wide, gsize x, gsize y,
+    guint v)
+{
+  guint8 *row = dst + y * p->dst_stride;
+
+  if (wide)
+    ((guint16 *) row)[x] = v;
+  else
+    row[x] = v;
+}
+
+static void
+expect_copy (const Params * p, guint8 * dst)
+{
+  gsize x, y;
+
+  /* with equal strides, the padding in between the rows is copied too */
+  if (p->src_stride == p->dst_stride) {
+    memcpy (dst, p->src_a, p->src_stride * (p->rows - 1) + p->width);
+    return;
+  }
+
+  for (y = 0; y < p->rows; y++) {
+    for (x = 0; x < p->width; x++)
+      put_sample (dst, p, FALSE, x, y, src_sample (p->src_a, p, x, y));
+  }
+}
+
+static void
+expect_interleave (const Params * p, guint8 * dst)
+{
+  gsize x, y;
+
+  for (y = 0; y < p->rows; y++) {
+    for (x = 0; x < p->width; x++) {
+      put_sample (dst, p, FALSE, 2 * x, y, src_sample (p->src_a, p, x, y));
+      put_sample (dst, p, FALSE, 2 * x + 1, y, src_sample (p->src_b, p, x,
+              y));
+    }
+  }
+}
+
+/* rounded average of the existing samples of block (@bx, @by), with
+ * @p->shift more bits dropped */
+static guint
+box_average (const guint8 * plane, const Params * p, gsize bx, gsize by)
+{
+  guint64 sum = 0, n = 0, d;
+  gsize x, y;
+
+  for (y = by * p->scale; y < MIN ((by + 1) * p->scale, p->rows); y++) {
+    for (x = bx * p->scale; x < MIN ((bx + 1) * p->scale, p->width); x++) {
+      sum += src_sample (plane, p, x, y);
+      n++;
+    }
+  }
+
+  d = n << p->shift;
+  return (2 * sum + d) / (2 * d);
+}
+
+static void
+expect_downscale (const Params * p, guint8 * dst)
+{
+  gboolean wide = p->pstride == 2 && p->shift == 0;
+  gsize x, y;
+
+  for (y = 0; y < (p->rows + p->scale - 1) / p->scale; y++) {
+    for (x = 0; x < (p->width + p->scale - 1) / p->scale; x++) {
+      guint v = box_average (p->src_a, p, x, y);
+
+      put_sample (dst, p, wide, x, y, wide ? v : MIN (v, 255));
+    }
+  }
+}
+
+static void
+expect_downscale_interleave (const Params * p, guint8 * dst)
+{
+  gsize x, y;
+
+  for (y = 0; y < (p->rows + p->scale - 1) / p->scale; y++) {
+    for (x = 0; x < (p->width + p->scale - 1) / p->scale; x++) {
+      put_sample (dst, p, FALSE, 2 * x, y,
+          MIN (box_average (p->src_a, p, x, y), 255));
+      put_sample (dst, p, FALSE, 2 * x + 1, y,
+          MIN (box_average (p->src_b, p, x, y), 255));
+    }
+  }
+}
+
+/* (v + round) >> shift, with the threshold of the 4x4 ordered dither
+ * matrix at the sample's position in the picture instead of the rounding */
+static guint
+reduce_sample (const guint8 * plane, const Params * p, gsize x, gsize y)
+{
+  guint round;
+
+  if (p->dither)
+    round = (dither_matrix[(p->first_row + y) & 3][x & 3] << p->shift) >> 4;
+  else
+    round = 1 << (p->shift - 1);
+
+  return MIN ((src_sample (plane, p, x, y) + round) >> p->shift, 255);
+}
+
+static void
+expect_reduce (const Params * p, guint8 * dst)
+{
+  gsize x, y;
+
+  for (y = 0; y < p->rows; y++) {
+    for (x = 0; x < p->width; x++)
+      put_sample (dst, p, FALSE, x, y, reduce_sample (p->src_a, p, x, y));
+  }
+}
+
+static void
+expect_reduce_interleave (const Params * p, guint8 * dst)
+{
+  gsize x, y;
+
+  for (y = 0; y < p->rows; y++) {
+    for (x = 0; x < p->width; x++) {
+      put_sample (dst, p, FALSE, 2 * x, y, reduce_sample (p->src_a, p, x, y));
+      put_sample (dst, p, FALSE, 2 * x + 1, y, reduce_sample (p->src_b, p, x,
+              y));
+    }
+  }
+}
+
+static void
+test_copy_plane (void)
+{
+  Params p = { 0, };
+
+  p.pstride = 1;
+  for (p.non_temporal = FALSE; p.non_temporal <= TRUE; p.non_temporal++) {
+    /* equal strides go through a single copy of all rows */
+    for (p.same_stride = FALSE; p.same_stride <= TRUE; p.same_stride++)
+      check_plane_kernel ("copy", run_copy, expect_copy, &p, FALSE,
+          same_row_bytes, same_rows);
+  }
+}
+
+static void
+test_interleave_plane (void)
+{
+  Params p = { 0, };
+
+  p.pstride = 1;
+  check_plane_kernel ("interleave", run_interleave, expect_interleave, &p,
+      TRUE, interleaved_row_bytes, same_rows);
+}
+
+static void
+test_downscale_plane (void)
+{
+  Params p = { 0, };
+
+  for (p.scale = 2; p.scale <= 8; p.scale *= 2) {
+    /* 8 bit, 10 bit, and 10 bit to 8 bit */
+    p.pstride = 1;
+    p.shift = 0;
+    check_plane_kernel ("downscale", run_downscale, expect_downscale, &p,
+        FALSE, downscaled_row_bytes, downscaled_rows);
+    p.pstride = 2;
+    check_plane_kernel ("downscale", run_downscale, expect_downscale, &p,
+        FALSE, downscaled_row_bytes, downscaled_rows);
+    p.shift = 2;
+    check_plane_kernel ("downscale", run_downscale, expect_downscale, &p,
+        FALSE, downscaled_row_bytes, downscaled_rows);
+  }
+}
+
+static void
+test_downscale_interleave_plane (void)
+{
+  Params p = { 0, };
+
+  for (p.scale = 2; p.scale <= 8; p.scale *= 2) {
+    p.pstride = 1;
+    p.shift = 0;
+    check_plane_kernel ("downscale-interleave", run_downscale_interleave,
+        expect_downscale_interleave, &p, TRUE,
+        downscaled_interleaved_row_bytes, downscaled_rows);
+    p.pstride = 2;
+    p.shift = 2;
+    check_plane_kernel ("downscale-interleave", run_downscale_interleave,
+        expect_downscale_interleave, &p, TRUE,
+        downscaled_interleaved_row_bytes, downscaled_rows);
+  }
+}
+
+static void
+test_reduce_plane (void)
+{
+  Params p = { 0, };
+
+  p.pstride = 2;
+  p.shift = 2;
+  for (p.dither = FALSE; p.dither <= TRUE; p.dither++) {
+    for (p.first_row = 0; p.first_row < 4; p.first_row += 3) {
+      check_plane_kernel ("reduce", run_reduce, expect_reduce, &p, FALSE,
+          reduced_row_bytes, same_rows);
+      check_plane_kernel ("reduce-interleave", run_reduce_interleave,
+          expect_reduce_interleave, &p, TRUE, interleaved_row_bytes,
+          same_rows);
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  guint i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (i = 0; gst_openhevc_copy_impl_names[i]; i++) {
+    if (gst_openhevc_copy_set_impl (gst_openhevc_copy_impl_names[i]))
+      g_test_message ("comparing %s", gst_openhevc_copy_impl_names[i]);
+  }
+
+  g_test_add_func ("/openhevc/copy/plane", test_copy_plane);
+  g_test_add_func ("/openhevc/copy/interleave", test_interleave_plane);
+  g_test_add_func ("/openhevc/copy/downscale", test_downscale_plane);
+  g_test_add_func ("/openhevc/copy/downscale-interleave",
+      test_downscale_interleave_plane);
+  g_test_add_func ("/openhevc/copy/reduce", test_reduce_plane);
+
+  return g_test_run ();
+}
@@ -0,0 +1,258 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the ring of frames handed to the decoder: lookups, eviction of
+ * frames a whole ring older, removing the frames older than a limit, and
+ * system_frame_number wrapping around. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstopenhevcframetable.h"
+
+#define TABLE_SIZE GST_OPENHEVC_FRAME_TABLE_SIZE
+
+/* frames are only ever freed here, the table and the tests just take and
+ * drop references on top of the one held by @frames */
+static GstVideoCodecFrame *
+new_frame (guint32 system_frame_number)
+{
+  GstVideoCodecFrame *frame = g_slice_new0 (GstVideoCodecFrame);
+
+  frame->ref_count = 1;
+  frame->system_frame_number = system_frame_number;
+
+  return frame;
+}
+
+static GstVideoCodecFrame **
+new_frames (guint32 first, guint n)
+{
+  GstVideoCodecFrame **frames = g_new (GstVideoCodecFrame *, n);
+  guint i;
+
+  for (i = 0; i < n; i++)
+    frames[i] = new_frame (first + i);
+
+  return frames;
+}
+
+/* checks that nothing references @frames any more */
+static void
+free_frames (GstVideoCodecFrame ** frames, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    g_assert_cmpint (frames[i]->ref_count, ==, 1);
+    g_slice_free (GstVideoCodecFrame, frames[i]);
+  }
+  g_free (frames);
+}
+
+/* @expected was in @table, drops the reference it returned */
+static void
+assert_removed (GstVideoCodecFrame * frame, GstVideoCodecFrame * expected)
+{
+  g_assert_true (frame == expected);
+  g_assert_cmpint (frame->ref_count, ==, 2);
+  gst_video_codec_frame_unref (frame);
+}
+
+static void
+test_insert_take (void)
+{
+  GstOpenHEVCFrameTable table;
+  GstVideoCodecFrame **frames = new_frames (0, 10);
+  guint i;
+
+  gst_openhevc_frame_table_init (&table);
+
+  for (i = 0; i < 10; i++) {
+    g_assert_null (gst_openhevc_frame_table_insert (&table, frames[i]));
+    g_assert_cmpint (frames[i]->ref_count, ==, 2);
+  }
+  g_assert_cmpuint (table.n_frames, ==, 10);
+
+  /* in another order than inserted */
+  assert_removed (gst_openhevc_frame_table_take (&table, 7), frames[7]);
+  assert_removed (gst_openhevc_frame_table_take (&table, 0), frames[0]);
+  g_assert_null (gst_openhevc_frame_table_take (&table, 7));
+  g_assert_cmpuint (table.n_frames, ==, 8);
+
+  /* same slot, but not the same frame */
+  g_assert_null (gst_openhevc_frame_table_take (&table, 3 + TABLE_SIZE));
+  g_assert_null (gst_openhevc_frame_table_take (&table, 10));
+  g_assert_cmpuint (table.n_frames, ==, 8);
+
+  for (i = 9; i > 0; i--) {
+    if (i != 7)
+      assert_removed (gst_openhevc_frame_table_take (&table, i), frames[i]);
+  }
+  g_assert_cmpuint (table.n_frames, ==, 0);
+
+  gst_openhevc_frame_table_clear (&table);
+  free_frames (frames, 10);
+}
+
+static void
+test_eviction (void)
+{
+  GstOpenHEVCFrameTable table;
+  GstVideoCodecFrame **frames = new_frames (0, 2 * TABLE_SIZE + 1);
+  guint i;
+
+  gst_openhevc_frame_table_init (&table);
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    g_assert_null (gst_openhevc_frame_table_insert (&table, frames[i]));
+  g_assert_cmpuint (table.n_frames, ==, TABLE_SIZE);
+
+  /* every further frame evicts the one a whole ring older, unless that
+   * was taken already */
+  assert_removed (gst_openhevc_frame_table_take (&table, 1), frames[1]);
+  for (i = TABLE_SIZE; i < 2 * TABLE_SIZE + 1; i++) {
+    GstVideoCodecFrame *evicted =
+        gst_openhevc_frame_table_insert (&table, frames[i]);
+
+    if (i == TABLE_SIZE + 1)
+      g_assert_null (evicted);
+    else
+      assert_removed (evicted, frames[i - TABLE_SIZE]);
+  }
+  g_assert_cmpuint (table.n_frames, ==, TABLE_SIZE);
+
+  /* the evicted frames are gone */
+  g_assert_null (gst_openhevc_frame_table_take (&table, 0));
+  g_assert_null (gst_openhevc_frame_table_take (&table, TABLE_SIZE));
+  assert_removed (gst_openhevc_frame_table_take (&table, 2 * TABLE_SIZE),
+      frames[2 * TABLE_SIZE]);
+
+  gst_openhevc_frame_table_clear (&table);
+  g_assert_cmpuint (table.n_frames, ==, 0);
+  free_frames (frames, 2 * TABLE_SIZE + 1);
+}
+
+static void
+test_pop_older (void)
+{
+  GstOpenHEVCFrameTable table;
+  GstVideoCodecFrame **frames = new_frames (100, 20);
+  guint i;
+
+  gst_openhevc_frame_table_init (&table);
+
+  /* out of order, like frames a decoder reorders */
+  for (i = 0; i < 20; i++) {
+    guint j = i ^ 1;
+
+    g_assert_null (gst_openhevc_frame_table_insert (&table, frames[j]));
+  }
+  g_assert_cmpuint (table.oldest, ==, 100);
+
+  assert_removed (gst_openhevc_frame_table_take (&table, 101), frames[1]);
+  assert_removed (gst_openhevc_frame_table_take (&table, 104), frames[4]);
+
+  /* nothing older than the oldest */
+  g_assert_null (gst_openhevc_frame_table_pop_older (&table, 100));
+
+  /* oldest first, skipping the taken ones */
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 106), frames[0]);
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 106), frames[2]);
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 106), frames[3]);
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 106), frames[5]);
+  g_assert_null (gst_openhevc_frame_table_pop_older (&table, 106));
+  g_assert_cmpuint (table.n_frames, ==, 14);
+
+  /* far beyond the end empties the table */
+  for (i = 6; i < 20; i++) {
+    assert_removed (gst_openhevc_frame_table_pop_older (&table, 100000),
+        frames[i]);
+  }
+  g_assert_null (gst_openhevc_frame_table_pop_older (&table, 100000));
+  g_assert_cmpuint (table.n_frames, ==, 0);
+
+  /* an empty table restarts at whatever comes next */
+  g_assert_null (gst_openhevc_frame_table_insert (&table, frames[10]));
+  g_assert_cmpuint (table.oldest, ==, 110);
+  assert_removed (gst_openhevc_frame_table_take (&table, 110), frames[10]);
+
+  gst_openhevc_frame_table_clear (&table);
+  free_frames (frames, 20);
+}
+
+static void
+test_wraparound (void)
+{
+  GstOpenHEVCFrameTable table;
+  guint32 first = G_MAXUINT32 - 9;
+  GstVideoCodecFrame **frames = new_frames (first, TABLE_SIZE + 20);
+  guint i;
+
+  gst_openhevc_frame_table_init (&table);
+
+  for (i = 0; i < 20; i++)
+    g_assert_null (gst_openhevc_frame_table_insert (&table, frames[i]));
+  g_assert_cmpuint (table.oldest, ==, first);
+
+  /* 0 and up come after G_MAXUINT32 */
+  assert_removed (gst_openhevc_frame_table_take (&table, 0), frames[10]);
+  for (i = 0; i < 10; i++) {
+    assert_removed (gst_openhevc_frame_table_pop_older (&table, 2),
+        frames[i]);
+  }
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 2), frames[11]);
+  g_assert_null (gst_openhevc_frame_table_pop_older (&table, 2));
+  g_assert_cmpuint (table.n_frames, ==, 8);
+
+  /* eviction across the wraparound */
+  for (i = 20; i < TABLE_SIZE + 12; i++)
+    g_assert_null (gst_openhevc_frame_table_insert (&table, frames[i]));
+  assert_removed (gst_openhevc_frame_table_insert (&table,
+          frames[TABLE_SIZE + 12]), frames[12]);
+  g_assert_cmpuint (table.n_frames, ==, TABLE_SIZE);
+
+  /* an earlier frame inserted late is the oldest again */
+  gst_openhevc_frame_table_clear (&table);
+  g_assert_null (gst_openhevc_frame_table_insert (&table, frames[15]));
+  g_assert_null (gst_openhevc_frame_table_insert (&table, frames[5]));
+  g_assert_cmpuint (table.oldest, ==, first + 5);
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 10), frames[5]);
+  assert_removed (gst_openhevc_frame_table_pop_older (&table, 10), frames[15]);
+
+  gst_openhevc_frame_table_clear (&table);
+  free_frames (frames, TABLE_SIZE + 20);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/openhevc/frametable/insert-take", test_insert_take);
+  g_test_add_func ("/openhevc/frametable/eviction", test_eviction);
+  g_test_add_func ("/openhevc/frametable/pop-older", test_pop_older);
+  g_test_add_func ("/openhevc/frametable/wraparound", test_wraparound);
+
+  return g_test_run ();
+}
@@ -0,0 +1,281 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the conversion of hvcC codec_data and length prefixed access units
+ * into byte-stream format, for all NAL length sizes and with lengths that
+ * run past the end of the data. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "gstopenhevcnal.h"
+
+#define MAX_AU_SIZE 256
+
+static const guint8 vps[] = { 0x40, 0x01, 0x0c, 0x01, 0xff };
+static const guint8 sps[] = { 0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00 };
+static const guint8 pps[] = { 0x44, 0x01, 0xc1 };
+static const guint8 pps2[] = { 0x44, 0x01, 0xc0, 0xf3 };
+static const guint8 idr[] = { 0x26, 0x01, 0xaf, 0x00, 0x00, 0x03, 0x01 };
+static const guint8 sei[] = { 0x4e, 0x01 };
+
+typedef struct
+{
+  const guint8 *data;
+  guint size;
+} Nal;
+
+static const Nal au_nals[] = {
+  {vps, sizeof (vps)}, {sps, sizeof (sps)}, {pps, sizeof (pps)},
+  {sei, sizeof (sei)}, {NULL, 0}, {idr, sizeof (idr)},
+};
+
+static void
+write_length (guint8 * out, guint nal_length_size, guint32 len)
+{
+  switch (nal_length_size) {
+    case 1:
+      out[0] = len;
+      break;
+    case 2:
+      GST_WRITE_UINT16_BE (out, len);
+      break;
+    case 3:
+      GST_WRITE_UINT24_BE (out, len);
+      break;
+    default:
+      GST_WRITE_UINT32_BE (out, len);
+      break;
+  }
+}
+
+/* writes @nals with @nal_length_size byte length prefixes, or start codes
+ * if 0 */
+static gsize
+write_au (guint8 * out, const Nal * nals, guint n_nals, guint nal_length_size)
+{
+  gsize size = 0;
+  guint i;
+
+  for (i = 0; i < n_nals; i++) {
+    if (nal_length_size == 0) {
+      memcpy (out + size, gst_openhevc_nal_start_code, 4);
+      size += 4;
+    } else {
+      write_length (out + size, nal_length_size, nals[i].size);
+      size += nal_length_size;
+    }
+    if (nals[i].size > 0)
+      memcpy (out + size, nals[i].data, nals[i].size);
+    size += nals[i].size;
+  }
+
+  g_assert_cmpuint (size, <=, MAX_AU_SIZE);
+
+  return size;
+}
+
+/* HEVCDecoderConfigurationRecord with one array per parameter set type */
+static gsize
+write_hvcc (guint8 * out, guint nal_length_size)
+{
+  static const Nal arrays[][2] = {
+    {{vps, sizeof (vps)}},
+    {{sps, sizeof (sps)}},
+    {{pps, sizeof (pps)}, {pps2, sizeof (pps2)}},
+  };
+  static const guint8 types[] = { 32, 33, 34 };
+  static const guint n_nals[] = { 1, 1, 2 };
+  gsize size = 23;
+  guint i, j;
+
+  memset (out, 0, 23);
+  out[0] = 1;
+  out[21] = 0xfc | (nal_length_size - 1);
+  out[22] = G_N_ELEMENTS (types);
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++) {
+    out[size] = 0x80 | types[i];
+    GST_WRITE_UINT16_BE (out + size + 1, n_nals[i]);
+    size += 3;
+    for (j = 0; j < n_nals[i]; j++) {
+      GST_WRITE_UINT16_BE (out + size, arrays[i][j].size);
+      memcpy (out + size + 2, arrays[i][j].data, arrays[i][j].size);
+      size += 2 + arrays[i][j].size;
+    }
+  }
+
+  return size;
+}
+
+static void
+test_hvcc (void)
+{
+  static const Nal ps_nals[] = {
+    {vps, sizeof (vps)}, {sps, sizeof (sps)}, {pps, sizeof (pps)},
+    {pps2, sizeof (pps2)},
+  };
+  guint8 hvcc[MAX_AU_SIZE], expected[MAX_AU_SIZE];
+  gsize size, expected_size;
+  guint nal_length_size, len;
+  GByteArray *ps;
+
+  expected_size = write_au (expected, ps_nals, G_N_ELEMENTS (ps_nals), 0);
+
+  for (len = 1; len <= 4; len++) {
+    if (len == 3)
+      /* reserved */
+      continue;
+
+    size = write_hvcc (hvcc, len);
+    nal_length_size = 0;
+    ps = gst_openhevc_nal_parse_hvcc (hvcc, size, &nal_length_size);
+    g_assert_nonnull (ps);
+    g_assert_cmpuint (nal_length_size, ==, len);
+    g_assert_cmpmem (ps->data, ps->len, expected, expected_size);
+    g_byte_array_unref (ps);
+  }
+
+  /* no parameter sets at all */
+  write_hvcc (hvcc, 4);
+  hvcc[22] = 0;
+  ps = gst_openhevc_nal_parse_hvcc (hvcc, 23, &nal_length_size);
+  g_assert_nonnull (ps);
+  g_assert_cmpuint (ps->len, ==, 0);
+  g_byte_array_unref (ps);
+}
+
+static void
+test_hvcc_truncated (void)
+{
+  guint8 hvcc[MAX_AU_SIZE];
+  gsize size, full_size;
+  guint nal_length_size = 0;
+
+  full_size = write_hvcc (hvcc, 4);
+  for (size = 0; size < full_size; size++)
+    g_assert_null (gst_openhevc_nal_parse_hvcc (hvcc, size,
+            &nal_length_size));
+  /* untouched on failure */
+  g_assert_cmpuint (nal_length_size, ==, 0);
+
+  /* a NAL unit claiming more than there is */
+  GST_WRITE_UINT16_BE (hvcc + 23 + 3, 0xffff);
+  g_assert_null (gst_openhevc_nal_parse_hvcc (hvcc, full_size,
+          &nal_length_size));
+}
+
+static void
+test_in_place (void)
+{
+  guint8 au[MAX_AU_SIZE], expected[MAX_AU_SIZE];
+  gsize size, expected_size;
+
+  size = write_au (au, au_nals, G_N_ELEMENTS (au_nals), 4);
+  expected_size = write_au (expected, au_nals, G_N_ELEMENTS (au_nals), 0);
+
+  g_assert_true (gst_openhevc_nal_to_byte_stream_in_place (au, size));
+  g_assert_cmpmem (au, size, expected, expected_size);
+
+  g_assert_true (gst_openhevc_nal_to_byte_stream_in_place (au, 0));
+}
+
+static void
+test_length_sizes (void)
+{
+  guint8 au[MAX_AU_SIZE], out[MAX_AU_SIZE], expected[MAX_AU_SIZE];
+  gsize size, out_size, expected_size;
+  guint len;
+
+  expected_size = write_au (expected, au_nals, G_N_ELEMENTS (au_nals), 0);
+
+  for (len = 1; len <= 4; len++) {
+    size = write_au (au, au_nals, G_N_ELEMENTS (au_nals), len);
+
+    out_size = 0;
+    g_assert_true (gst_openhevc_nal_byte_stream_size (au, size, len,
+            &out_size));
+    g_assert_cmpuint (out_size, ==, expected_size);
+
+    memset (out, 0xaa, sizeof (out));
+    gst_openhevc_nal_to_byte_stream (au, size, len, out);
+    g_assert_cmpmem (out, out_size, expected, expected_size);
+    /* nothing written past the end */
+    g_assert_cmpuint (out[out_size], ==, 0xaa);
+  }
+
+  g_assert_true (gst_openhevc_nal_byte_stream_size (au, 0, 2, &out_size));
+  g_assert_cmpuint (out_size, ==, 0);
+}
+
+static void
+test_invalid_length (void)
+{
+  guint8 au[MAX_AU_SIZE];
+  gsize size, out_size, cut;
+  guint len;
+
+  for (len = 1; len <= 4; len++) {
+    size = write_au (au, au_nals, G_N_ELEMENTS (au_nals), len);
+
+    /* the last NAL unit, or its length prefix, cut short */
+    for (cut = 1; cut < len + sizeof (idr); cut++)
+      g_assert_false (gst_openhevc_nal_byte_stream_size (au, size - cut, len,
+              &out_size));
+
+    /* a length running past the end */
+    write_length (au + size - len - sizeof (idr), len, sizeof (idr) + 1);
+    g_assert_false (gst_openhevc_nal_byte_stream_size (au, size, len,
+            &out_size));
+
+    if (len == 4) {
+      g_assert_false (gst_openhevc_nal_to_byte_stream_in_place (au, size));
+
+      for (cut = 1; cut < len + sizeof (idr); cut++) {
+        size = write_au (au, au_nals, G_N_ELEMENTS (au_nals), len);
+        g_assert_false (gst_openhevc_nal_to_byte_stream_in_place (au,
+                size - cut));
+      }
+
+      /* lengths that overflow when added to the position */
+      size = write_au (au, au_nals, G_N_ELEMENTS (au_nals), len);
+      GST_WRITE_UINT32_BE (au, G_MAXUINT32);
+      g_assert_false (gst_openhevc_nal_to_byte_stream_in_place (au, size));
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/openhevc/nal/hvcc", test_hvcc);
+  g_test_add_func ("/openhevc/nal/hvcc-truncated", test_hvcc_truncated);
+  g_test_add_func ("/openhevc/nal/in-place", test_in_place);
+  g_test_add_func ("/openhevc/nal/length-sizes", test_length_sizes);
+  g_test_add_func ("/openhevc/nal/invalid-length", test_invalid_length);
+
+  return g_test_run ();
+}
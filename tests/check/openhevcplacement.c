@@ -0,0 +1,113 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the parsing and normalizing of the CPU lists given in the cpus
+ * property and read from sysfs. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include "gstopenhevcplacement.h"
+
+GST_DEBUG_CATEGORY (openhevc_debug);
+
+static void
+assert_normalized (const gchar * cpu_list, const gchar * expected)
+{
+  gchar *normalized = gst_openhevc_placement_normalize_cpus (cpu_list);
+
+  g_assert_cmpstr (normalized, ==, expected);
+  g_free (normalized);
+}
+
+static void
+test_normalize (void)
+{
+  assert_normalized ("0", "0");
+  assert_normalized ("0-3,8,10-11", "0-3,8,10-11");
+  /* sorted and merged */
+  assert_normalized ("8,0-3", "0-3,8");
+  assert_normalized ("3,1,2,0", "0-3");
+  assert_normalized ("0-3,2-5,6", "0-6");
+  assert_normalized ("4,4,4-4", "4");
+  assert_normalized ("1,3,5", "1,3,5");
+  /* like the sysfs cpulist files */
+  assert_normalized ("0-7\n", "0-7");
+  assert_normalized (" 1 , 2 ", "1-2");
+  assert_normalized ("1,", "1");
+  /* the highest CPU number there is room for */
+  assert_normalized ("1023", "1023");
+  assert_normalized ("1022-1023,0", "0,1022-1023");
+  assert_normalized ("0-1023", "0-1023");
+}
+
+static void
+test_invalid (void)
+{
+  static const gchar *const invalid[] = {
+    "", " ", "\n", ",", ",1", "a", "1a", "0x1", "-1", "1-", "1--2", "3-1",
+    "1-2-3", "1;2", "1 2", "1,,2", "1024", "0-1024", "99999999999999999999",
+    "0-99999999999999999999", "+1",
+  };
+  guint i;
+
+  g_assert_null (gst_openhevc_placement_normalize_cpus (NULL));
+
+  for (i = 0; i < G_N_ELEMENTS (invalid); i++) {
+    gchar *normalized = gst_openhevc_placement_normalize_cpus (invalid[i]);
+
+    if (normalized)
+      g_error ("\"%s\" normalized to \"%s\"", invalid[i], normalized);
+  }
+}
+
+static void
+test_resolve (void)
+{
+  gchar *cpus;
+
+  /* an explicit list wins over the NUMA node */
+  cpus = gst_openhevc_placement_resolve_cpus ("2,0-1", 0);
+  g_assert_cmpstr (cpus, ==, "0-2");
+  g_free (cpus);
+
+  cpus = gst_openhevc_placement_resolve_cpus ("x", -1);
+  g_assert_null (cpus);
+
+  /* neither, unrestricted */
+  cpus = gst_openhevc_placement_resolve_cpus (NULL, -1);
+  g_assert_null (cpus);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (openhevc_debug, "openhevc", 0, "openhevc tests");
+
+  g_test_add_func ("/openhevc/placement/normalize", test_normalize);
+  g_test_add_func ("/openhevc/placement/invalid", test_invalid);
+  g_test_add_func ("/openhevc/placement/resolve", test_resolve);
+
+  return g_test_run ();
+}
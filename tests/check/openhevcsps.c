@@ -0,0 +1,352 @@
+/* GStreamer
+ * Copyright (C) 2018 Matthew Waters <matthew@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the SPS parser on sequence parameter sets written here, including
+ * emulation prevention bytes, sub-layers, truncation and out of range DPB
+ * values. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "gstopenhevcsps.h"
+
+#define MAX_SPS_SIZE 256
+
+/* the fields the parser reads, coded as in the bitstream */
+typedef struct
+{
+  guint max_sub_layers_minus1;
+  guint chroma_format_idc;
+  gboolean separate_colour_plane;
+  guint width;
+  guint height;
+  gboolean conformance_window;
+  guint conf_win_offset[4];
+  guint bit_depth_luma_minus8;
+  guint bit_depth_chroma_minus8;
+  gboolean ordering_info_present;
+  guint max_dec_pic_buffering_minus1[7];
+  guint max_num_reorder_pics[7];
+  guint max_latency_increase_plus1[7];
+} SpsDesc;
+
+typedef struct
+{
+  guint8 data[MAX_SPS_SIZE];
+  gsize size;
+  /* bits of the byte being written */
+  guint8 cur;
+  guint bit;
+  guint zeros;
+} BitWriter;
+
+static void
+put_byte (BitWriter * bw, guint8 byte)
+{
+  /* emulation prevention */
+  if (bw->zeros >= 2 && byte <= 3) {
+    g_assert_cmpuint (bw->size, <, MAX_SPS_SIZE);
+    bw->data[bw->size++] = 0x03;
+    bw->zeros = 0;
+  }
+  g_assert_cmpuint (bw->size, <, MAX_SPS_SIZE);
+  bw->data[bw->size++] = byte;
+  bw->zeros = byte == 0 ? bw->zeros + 1 : 0;
+}
+
+static void
+put_bits (BitWriter * bw, guint32 val, guint n)
+{
+  while (n--) {
+    bw->cur = (bw->cur << 1) | ((val >> n) & 1);
+    if (++bw->bit == 8) {
+      put_byte (bw, bw->cur);
+      bw->bit = 0;
+      bw->cur = 0;
+    }
+  }
+}
+
+static void
+put_ue (BitWriter * bw, guint32 val)
+{
+  guint64 v = (guint64) val + 1;
+  guint len = 0;
+
+  while ((v >> len) > 1)
+    len++;
+  put_bits (bw, 0, len);
+  put_bits (bw, 1, 1);
+  put_bits (bw, v & ((G_GUINT64_CONSTANT (1) << len) - 1), len);
+}
+
+static void
+write_sps (BitWriter * bw, const SpsDesc * desc)
+{
+  guint i, n = desc->max_sub_layers_minus1;
+
+  memset (bw, 0, sizeof (*bw));
+
+  /* NAL unit header, SPS_NUT */
+  put_bits (bw, 0x4201, 16);
+
+  put_bits (bw, 0, 4);
+  put_bits (bw, n, 3);
+  put_bits (bw, 1, 1);
+
+  /* general profile_tier_level, Main profile with the flags and
+   * constraints all zero so that emulation prevention kicks in */
+  put_bits (bw, 1, 8);
+  put_bits (bw, 0x60000000, 32);
+  put_bits (bw, 0, 32);
+  put_bits (bw, 0, 16);
+  put_bits (bw, 93, 8);
+  for (i = 0; i < n; i++) {
+    /* sub_layer_profile_present_flag only on the odd ones */
+    put_bits (bw, i & 1, 1);
+    put_bits (bw, 1, 1);
+  }
+  if (n > 0)
+    put_bits (bw, 0, 2 * (8 - n));
+  for (i = 0; i < n; i++) {
+    if (i & 1) {
+      put_bits (bw, 0, 32);
+      put_bits (bw, 0, 32);
+      put_bits (bw, 0, 24);
+    }
+    put_bits (bw, 90, 8);
+  }
+
+  put_ue (bw, 0);
+  put_ue (bw, desc->chroma_format_idc);
+  if (desc->chroma_format_idc == 3)
+    put_bits (bw, desc->separate_colour_plane, 1);
+  put_ue (bw, desc->width);
+  put_ue (bw, desc->height);
+  put_bits (bw, desc->conformance_window, 1);
+  if (desc->conformance_window) {
+    for (i = 0; i < 4; i++)
+      put_ue (bw, desc->conf_win_offset[i]);
+  }
+  put_ue (bw, desc->bit_depth_luma_minus8);
+  put_ue (bw, desc->bit_depth_chroma_minus8);
+  put_ue (bw, 4);
+  put_bits (bw, desc->ordering_info_present, 1);
+  for (i = desc->ordering_info_present ? 0 : n; i <= n; i++) {
+    put_ue (bw, desc->max_dec_pic_buffering_minus1[i]);
+    put_ue (bw, desc->max_num_reorder_pics[i]);
+    put_ue (bw, desc->max_latency_increase_plus1[i]);
+  }
+
+  /* rest of the SPS isn't parsed, just the stop bit */
+  put_bits (bw, 1, 1);
+  while (bw->bit)
+    put_bits (bw, 0, 1);
+}
+
+static gboolean
+parse_desc (const SpsDesc * desc, GstOpenHEVCSPS * sps)
+{
+  BitWriter bw;
+
+  write_sps (&bw, desc);
+
+  return gst_openhevc_sps_parse (sps, bw.data, bw.size);
+}
+
+/* 1080p 4:2:0 8 bit, cropped from 1088 lines, with a single sub-layer */
+static void
+init_desc (SpsDesc * desc)
+{
+  memset (desc, 0, sizeof (*desc));
+  desc->chroma_format_idc = 1;
+  desc->width = 1920;
+  desc->height = 1088;
+  desc->conformance_window = TRUE;
+  desc->conf_win_offset[3] = 4;
+  desc->max_dec_pic_buffering_minus1[0] = 4;
+  desc->max_num_reorder_pics[0] = 2;
+}
+
+static void
+test_basic (void)
+{
+  GstOpenHEVCSPS sps;
+  SpsDesc desc;
+  BitWriter bw;
+
+  init_desc (&desc);
+  write_sps (&bw, &desc);
+  /* the all zero profile flags need escaping */
+  g_assert_nonnull (memchr (bw.data, 0x03, bw.size));
+
+  g_assert_true (gst_openhevc_sps_parse (&sps, bw.data, bw.size));
+  g_assert_cmpuint (sps.max_sub_layers, ==, 1);
+  g_assert_cmpuint (sps.chroma_format_idc, ==, 1);
+  g_assert_cmpuint (sps.width, ==, 1920);
+  g_assert_cmpuint (sps.height, ==, 1088);
+  g_assert_cmpuint (sps.bit_depth_luma, ==, 8);
+  g_assert_cmpuint (sps.bit_depth_chroma, ==, 8);
+  g_assert_cmpuint (sps.max_dec_pic_buffering, ==, 5);
+  g_assert_cmpuint (sps.max_num_reorder_pics, ==, 2);
+  g_assert_cmpuint (sps.max_latency_pictures, ==, 0);
+
+  desc.chroma_format_idc = 3;
+  desc.separate_colour_plane = TRUE;
+  desc.bit_depth_luma_minus8 = desc.bit_depth_chroma_minus8 = 2;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.chroma_format_idc, ==, 0);
+  g_assert_cmpuint (sps.bit_depth_luma, ==, 10);
+  g_assert_cmpuint (sps.bit_depth_chroma, ==, 10);
+}
+
+static void
+test_sub_layers (void)
+{
+  GstOpenHEVCSPS sps;
+  SpsDesc desc;
+  guint i;
+
+  init_desc (&desc);
+  desc.max_sub_layers_minus1 = 6;
+  desc.ordering_info_present = TRUE;
+  for (i = 0; i < 7; i++) {
+    desc.max_dec_pic_buffering_minus1[i] = i + 1;
+    desc.max_num_reorder_pics[i] = i;
+  }
+
+  /* the values of the highest sub-layer are kept */
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_sub_layers, ==, 7);
+  g_assert_cmpuint (sps.max_dec_pic_buffering, ==, 8);
+  g_assert_cmpuint (sps.max_num_reorder_pics, ==, 6);
+
+  /* without ordering info only the highest one is coded */
+  desc.ordering_info_present = FALSE;
+  desc.max_sub_layers_minus1 = 3;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_sub_layers, ==, 4);
+  g_assert_cmpuint (sps.max_dec_pic_buffering, ==, 5);
+  g_assert_cmpuint (sps.max_num_reorder_pics, ==, 3);
+}
+
+static void
+test_dpb_ranges (void)
+{
+  GstOpenHEVCSPS sps;
+  SpsDesc desc;
+
+  init_desc (&desc);
+
+  desc.max_dec_pic_buffering_minus1[0] = 15;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_dec_pic_buffering, ==, 16);
+
+  desc.max_dec_pic_buffering_minus1[0] = 16;
+  g_assert_false (parse_desc (&desc, &sps));
+  desc.max_dec_pic_buffering_minus1[0] = G_MAXUINT32 - 1;
+  g_assert_false (parse_desc (&desc, &sps));
+
+  /* at most max_dec_pic_buffering_minus1 reorder pictures */
+  desc.max_dec_pic_buffering_minus1[0] = 4;
+  desc.max_num_reorder_pics[0] = 4;
+  g_assert_true (parse_desc (&desc, &sps));
+  desc.max_num_reorder_pics[0] = 5;
+  g_assert_false (parse_desc (&desc, &sps));
+
+  /* a bad lower sub-layer fails too */
+  desc.max_num_reorder_pics[0] = 2;
+  desc.max_sub_layers_minus1 = 1;
+  desc.ordering_info_present = TRUE;
+  desc.max_dec_pic_buffering_minus1[1] = 4;
+  desc.max_num_reorder_pics[1] = 2;
+  desc.max_dec_pic_buffering_minus1[0] = 20;
+  g_assert_false (parse_desc (&desc, &sps));
+}
+
+static void
+test_latency (void)
+{
+  GstOpenHEVCSPS sps;
+  SpsDesc desc;
+
+  init_desc (&desc);
+
+  /* SpsMaxLatencyPictures = reorder + increase */
+  desc.max_latency_increase_plus1[0] = 2;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_latency_pictures, ==, 3);
+
+  /* bounded by the DPB */
+  desc.max_latency_increase_plus1[0] = 100;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_latency_pictures, ==, 4);
+
+  desc.max_latency_increase_plus1[0] = G_MAXUINT32 - 1;
+  g_assert_true (parse_desc (&desc, &sps));
+  g_assert_cmpuint (sps.max_latency_pictures, ==, 4);
+}
+
+static void
+test_invalid (void)
+{
+  GstOpenHEVCSPS sps;
+  SpsDesc desc;
+  BitWriter bw;
+  gsize size;
+
+  init_desc (&desc);
+  desc.chroma_format_idc = 4;
+  g_assert_false (parse_desc (&desc, &sps));
+
+  init_desc (&desc);
+  desc.width = 0;
+  g_assert_false (parse_desc (&desc, &sps));
+
+  /* cropping everything away */
+  init_desc (&desc);
+  desc.conf_win_offset[2] = 272;
+  desc.conf_win_offset[3] = 272;
+  g_assert_false (parse_desc (&desc, &sps));
+
+  /* truncated anywhere before the end of the ordering info */
+  init_desc (&desc);
+  write_sps (&bw, &desc);
+  for (size = 0; size + 1 < bw.size; size++)
+    g_assert_false (gst_openhevc_sps_parse (&sps, bw.data, size));
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/openhevc/sps/basic", test_basic);
+  g_test_add_func ("/openhevc/sps/sub-layers", test_sub_layers);
+  g_test_add_func ("/openhevc/sps/dpb-ranges", test_dpb_ranges);
+  g_test_add_func ("/openhevc/sps/latency", test_latency);
+  g_test_add_func ("/openhevc/sps/invalid", test_invalid);
+
+  return g_test_run ();
+}